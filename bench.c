@@ -0,0 +1,222 @@
+/* bench.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/*
+ * Engine benchmark: searches a fixed set of positions to a fixed depth,
+ * and reports the nodes searched, the nodes per second, and a signature
+ * of the node counts and moves found. The signature changes whenever the
+ * search does something different, so it catches unintended changes;
+ * nodes per second compares builds and machines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "panic.h"
+#include "move.h"
+#include "game.h"
+#include "engine.h"
+
+enum {
+	DEFAULT_MAX_DEPTH = 8,
+	DEFAULT_NUM_THREADS = 1,
+};
+
+/* moves from the initial position, as in the move history */
+static const char *const bench_positions[] = {
+	/* opening */
+	"",
+	/* opening */
+	"b4W a6B c4N Nb6N d3N Nc6B Bd2W o-o",
+	/* opening */
+	"a4W Nb6B o-o Nxa4W Nc3N Nc5B b4N Na6B c3W Nc6N b5N Nc5B",
+	/* middlegame */
+	"b4W a5N b4Wxa5N Nc6B Nb3N b6B a5Nxb6B c6N a4N Nxb6B Nc3N Bc7B "
+	"Bb2W Nc4N Bc3W Ba6B d3N Nb6B Nc5B Bc8B a3N d6B Nb3N Bb6N Nc5B "
+	"Bc5N Nb3N Bb6N a5N Nxa5N",
+	/* middlegame */
+	"a4W Nb6B a3W Nc6B Nc3N a6N b4N c6N Nb5B a6Nxb5B a4Wxb5B Na4W "
+	"b5Bxc6B d7Bxc6B Nb3N b5B c3N Bc7B o-o Ba6N Bd3N Qb8B Qa1QL1 "
+	"Bb5N Bxb5N Qxb5N d4N Qc4N Na5B Bxa5B b4Nxa5B Nxc3N Bb2W Nb5N "
+	"Qa2W Qa4N a4W Qxa2W z1QL1xa2W b5Bxa4W",
+	/* attack boards */
+	"Nb3N Nb6B Qa1W Qa8B Nc3N Nc6B Nc5B b6N Kd1W Kd8B Nb3W Qc6N a3N "
+	"a6B b3N a7B Ba3W Bb7B a2W a6N Qc3W d6B b4W d7B d4W Qxc3W "
+	"Ra0QL1 Qc4N Ra1W Qxc3N QL2 Nxd4W QL1 Nxb3W QL2 Qb4N QL1 Qd4N "
+	"d3N Qxa1W a2Wxb3W Qa2W QL2",
+	/* attack boards */
+	"Nb3N Nb6B Qa1W Nc6B Nc3N Qa8B Kd1W Kd8B Nc5B b6N Nb3W Qc6N "
+	"Nd5N Nxd5N a3N Bb7B a2W a6B b3N d5B a3W d6B b4N a7B Qa2W a6N "
+	"Qb3N b5B c3N Qc4N Bc2W Bc6N Bb2W Ra9QL6 d3N Ra7B d2W Qb5N d3W "
+	"QL5 Nc1W z4QL5xa3N Bxa3N KL5 Nb3W KL5 c4W KL5 c4Wxb5N QL5",
+	/* endgame */
+	"a4W c5B Nb3N d5N Nxc5B d6B Nb3N Nb6B Nc3N Nc6B b3W Bd6N c3W "
+	"a6B a5B Nc4N b3Wxc4N d5Nxc4N a2W Kd8B d4W Bc7B Nd5B Bd8KL6 "
+	"Nb6B Qd6N Nxc4N Qd5B Nb6B Qb5B Bd3N Kd9KL6 Bxb5B a6Bxb5B Nxc8B "
+	"Kxc8B Kd1W Nd8B Ba3N Nc6B Bxd6B a6B Bb4N b6N a3N b6Nxa5B Bc5B "
+	"Kc7B Nc5N Nb8B Kc2W Kc6B Kb3N Bb6B Qa3W Bxc5N Qxc5N Kd7B "
+	"Bxz8QL6 Nc6N Bc5B a4W Kc2W Nb8B Qb6B Rd9KL6 Qxb8B Kc6N Kd3W "
+	"Rxd4W Bxd4W KL5 Kxe4KL5 QL5 Qb6N Kd7B Qxa6B QL6 Rd0KL1 Kc7B "
+	"Qa8QL6 Rxz1QL1 a4N Rxz0QL1",
+	/* endgame */
+	"a4W c5B Nb3N Nc7B Nxc5B b6B Nb3N Nc6B c4N Ba6B b3W d5B d3N "
+	"d5Bxc4N d3Nxc4N a6N Nc3N b5B Nc5B Qa8B Nxa6B Qxa6B Bd3N "
+	"b5Bxa4W Bc4W Qc6N Nxa4W Na5B Qc2W Nxc4W a3W Nb6B Nxb6B Qxb6B "
+	"Qc4W a6B b4N d6B Bb2W Ba7B Qb4W Qc6B Bc3N Bb6N d3N Qa8QL6 "
+	"Qxb6N Qa9QL6 Qxd6B Kc8B Qb4W Kd9KL6 Qc4W Qa7B Qb4W Ra9QL6 d4N "
+	"Kc8B d5B Qb7B d6N Qxb4W a3Wxb4W Rd9KL6 o-o Na8QL6 Rd3N Nb6B "
+	"c5B Nc4N Rc3W Nxd6N c5Bxd6N Kd8B Rc4N Kd7B Rd4N Kc6B Kd0KL1 "
+	"Rxd6N Rxd6N Kxd6N Ra0QL1 Kc6B Ra5B Ra8QL6 Rc5B Kb6B Ra5N Rc8B "
+	"Bd4N Kb7B Bc5B Rc6B Bxz8QL6",
+	/* endgame */
+	"b3N Nb6B a3W Nc6B c4N Nd4N c5N Nd5B Nc3N c6B Nxd5B c6Bxd5B b4N "
+	"b5B Bd3N Bb7B Bb2W Nc6B Bxb5B a6B d4W a6Bxb5B Bc1W Nxd4W Qd3N "
+	"d6N Qxd4W d6B c6N Kd8KL6 c6Nxb7B a8QL6xb7B Qb6B Bc7B Qc5N "
+	"d6Bxc5N Nb3N Qa4W a4N Qxb3N a4Nxb5B Qxb4N Bb2W Kd9KL6 d3N Qc4N "
+	"o-o-o Qxb5B Rd1KL1 Bb6B Bc3N Qb3N Rb1W Qxe0KL1 Rxb6B Qc2W "
+	"Kz0QL1 Qxc3N Rxd6N Kc8B Rxd5B b6N Rd6N Qa5B d4W c5Nxd4W Rxd4W",
+};
+
+enum {
+	NUM_BENCH_POSITIONS =
+	  sizeof bench_positions/sizeof *bench_positions
+};
+
+/*
+ * set_bench_position --
+ *	Play the moves of a benchmark position on state. Returns the side
+ *	to move.
+ */
+static int
+set_bench_position(struct board_state *state, const char *moves)
+{
+	struct undo_move_info undo_info;
+	union move move;
+	char buf[1024], *p;
+	int side;
+
+	init_board_state(state);
+	side = 0;
+
+	if (strlen(moves) >= sizeof buf)
+		panic("benchmark position too long");
+
+	strcpy(buf, moves);
+
+	for (p = strtok(buf, " "); p != NULL; p = strtok(NULL, " ")) {
+		if (!parse_move(&move, state, side, p))
+			panic("invalid benchmark move: %s", p);
+
+		do_move(state, &move, &undo_info);
+		side ^= BLACK_FLAG;
+	}
+
+	return side;
+}
+
+/* FNV-1a, one 32 bit word at a time */
+static unsigned
+add_to_signature(unsigned signature, unsigned long value)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		signature ^= (value >> 8*i) & 0xff;
+		signature *= 16777619U;
+	}
+
+	return signature;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: vulcan-bench [options]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -d depth    search depth [%d]\n",
+	  DEFAULT_MAX_DEPTH);
+	fprintf(stderr, "  -t threads  number of search threads [%d]; the "
+	  "signature isn't\n              repeatable with more than one\n",
+	  DEFAULT_NUM_THREADS);
+	fprintf(stderr, "  -h          this help\n");
+
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct board_state state;
+	struct search_stats stats;
+	union move move;
+	unsigned long nodes;
+	unsigned signature;
+	long msecs;
+	int c, i, side, max_depth, num_threads;
+	char *p;
+
+	max_depth = DEFAULT_MAX_DEPTH;
+	num_threads = DEFAULT_NUM_THREADS;
+
+	while ((c = getopt(argc, argv, "d:t:h")) != EOF) {
+		switch (c) {
+			case 'd':
+				max_depth = strtol(optarg, &p, 10);
+				if (p == optarg || max_depth < 1)
+					usage();
+				break;
+
+			case 't':
+				num_threads = strtol(optarg, &p, 10);
+				if (p == optarg || num_threads < 1)
+					usage();
+				break;
+
+			case 'h':
+			default:
+				usage();
+		}
+	}
+
+	init_hash_keys();
+	init_move_tables();
+	init_engine(num_threads, LAZY_SMP);
+
+	nodes = 0;
+	msecs = 0;
+	signature = 2166136261U;
+
+	for (i = 0; i < NUM_BENCH_POSITIONS; i++) {
+		side = set_bench_position(&state, bench_positions[i]);
+
+		get_best_move(&move, &state, side, max_depth, 0);
+		get_search_stats(&stats);
+
+		printf("position %d: %s, nodes: %lu, msecs: %ld\n", i + 1,
+		  move_as_string(&state, &move), stats.nodes, stats.msecs);
+
+		nodes += stats.nodes;
+		msecs += stats.msecs;
+
+		signature = add_to_signature(signature, stats.nodes);
+		signature = add_to_signature(signature, pack_move(&move));
+	}
+
+	printf("\nnodes: %lu\n", nodes);
+	printf("msecs: %ld\n", msecs);
+	printf("nodes per second: %lu\n", msecs > 0 ? nodes*1000/msecs : 0);
+	printf("signature: %08x\n", signature);
+
+	return 0;
+}
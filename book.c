@@ -0,0 +1,187 @@
+/* book.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include "panic.h"
+#include "game.h"
+#include "move.h"
+#include "book.h"
+
+/* Windows reads files in text mode unless told otherwise */
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* the book file, mapped read-only */
+static struct {
+	void *base;
+	size_t size;
+	const struct book_entry *entries;
+	unsigned num_entries;
+} book;
+
+/*
+ * book_open --
+ *	Map the opening book at path. Returns 0 (and the book stays empty)
+ *	if there's no usable book there.
+ */
+int
+book_open(const char *path)
+{
+	int fd;
+	struct stat st;
+	const struct book_header *header;
+	void *base;
+
+	book_close();
+
+	if ((fd = open(path, O_RDONLY|O_BINARY)) < 0)
+		return 0;
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof *header) {
+		close(fd);
+		return 0;
+	}
+
+#ifndef _WIN32
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (base == MAP_FAILED) {
+		warn("couldn't map %s: %s", path, strerror(errno));
+		close(fd);
+		return 0;
+	}
+#else
+	if ((base = malloc(st.st_size)) == NULL ||
+	  read(fd, base, st.st_size) != st.st_size) {
+		free(base);
+		close(fd);
+		return 0;
+	}
+#endif
+
+	close(fd);
+
+	book.base = base;
+	book.size = st.st_size;
+
+	header = base;
+
+	if (memcmp(header->magic, BOOK_MAGIC, sizeof header->magic) ||
+	  header->byte_order != BOOK_BYTE_ORDER ||
+	  header->num_entries > (book.size - sizeof *header)/
+	    sizeof *book.entries) {
+		warn("%s is not an opening book for this machine", path);
+		book_close();
+		return 0;
+	}
+
+	book.entries = (const struct book_entry *)(header + 1);
+	book.num_entries = header->num_entries;
+
+	return 1;
+}
+
+void
+book_close(void)
+{
+	if (book.base != NULL) {
+#ifndef _WIN32
+		munmap(book.base, book.size);
+#else
+		free(book.base);
+#endif
+	}
+
+	memset(&book, 0, sizeof book);
+}
+
+/*
+ * book_probe --
+ *	Pick one of the book moves for the position, at random, in
+ *	proportion to their weights. Moves that aren't legal here (key
+ *	collisions) are skipped. Returns 0 if the position is out of book.
+ */
+int
+book_probe(union move *move, int *score, struct board_state *state,
+  int side)
+{
+	union move moves[MAX_MOVES];
+	const struct book_entry *p, *end, *chosen;
+	unsigned long long key;
+	unsigned lo, hi, mid;
+	int i, n, total_weight;
+
+	if (book.num_entries == 0)
+		return 0;
+
+	key = HASH_KEY(state, side);
+
+	/* first entry for key */
+
+	lo = 0;
+	hi = book.num_entries;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo)/2;
+
+		if (book.entries[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	p = &book.entries[lo];
+	end = &book.entries[book.num_entries];
+
+	if (p == end || p->key != key)
+		return 0;
+
+	n = get_legal_moves(moves, state, side);
+
+	chosen = NULL;
+	total_weight = 0;
+
+	for (; p != end && p->key == key; p++) {
+		for (i = 0; i < n; i++) {
+			if (pack_move(&moves[i]) == p->move)
+				break;
+		}
+
+		if (i == n || p->weight == 0)
+			continue;
+
+		total_weight += p->weight;
+
+		if (rand() % total_weight < p->weight) {
+			chosen = p;
+			*move = moves[i];
+		}
+	}
+
+	if (chosen == NULL)
+		return 0;
+
+	*score = chosen->score;
+
+	return 1;
+}
@@ -0,0 +1,53 @@
+/* book.h -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#ifndef BOOK_H_
+#define BOOK_H_
+
+/*
+ * Opening book file: a header followed by entries sorted by key, then
+ * move. Numbers are in host byte order; byte_order tells if the file was
+ * written on a host with a different one.
+ */
+
+#define BOOK_MAGIC "VBK1"
+
+enum {
+	BOOK_BYTE_ORDER = 0x01020304,
+	MAX_BOOK_WEIGHT = 65535,
+};
+
+struct book_header {
+	char magic[4];
+	unsigned byte_order;
+	unsigned num_entries;
+	unsigned reserved;
+};
+
+struct book_entry {
+	unsigned long long key;		/* HASH_KEY of the position */
+	unsigned move;			/* packed move */
+	unsigned short weight;		/* times chosen when building */
+	short score;			/* for the side to move */
+};
+
+int
+book_open(const char *path);
+
+void
+book_close(void);
+
+int
+book_probe(union move *move, int *score, struct board_state *state,
+  int side);
+
+#endif /* BOOK_H_ */
@@ -16,215 +16,2045 @@
 #include <assert.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
 #include "move.h"
 #include "game.h"
 #include "engine.h"
+#include "book.h"
 
 enum {
-	INFINITY = 1000000
+	INFINITY = 1000000,
+	MATE_SCORE = 900000,		/* minus distance to mate in plies */
+	MAX_PLY = 128,
+	CHECK_TIME_INTERVAL = 1024,	/* nodes between clock checks */
+	ASPIRATION_WINDOW = 5,		/* half a pawn */
+	MIN_ASPIRATION_DEPTH = 2,
+	NUM_KILLERS = 2,
+	NUM_SQUARE_PIECES = (BLACK_FLAG|PIECE_MASK) + 1,
+	MAX_HISTORY_SCORE = 1 << 24,
+	DELTA_MARGIN = 20,		/* two pawns */
+	MAX_SEARCH_THREADS = 64,
+	MAX_SPLIT_POINTS = 256,
+	MIN_SPLIT_DEPTH = 2,		/* don't share out smaller subtrees */
+	NULL_MOVE_MIN_DEPTH = 2,
+	NULL_MOVE_REDUCTION = 2,
+	NULL_MOVE_VERIFY_DEPTH = 5,	/* verify null move cutoffs from here */
+	LMR_MIN_DEPTH = 2,
+	LMR_MIN_MOVES = 3,		/* moves searched before reducing */
+	LMR_LATE_MOVES = 8,		/* moves searched before reducing by 2 */
+	PONDER_WAIT_USECS = 10000,	/* poll interval after pondering */
 };
 
-static int square_scores[] = {
-  -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, 0, 0, -1, -1, 0, 0, -1,
-  -1, 0, 0, 0, 0, 0, 0, -1,
-  -1, 0, 0, 1, 1, 0, 0, -1,
-  -1, 0, 1, 2, 2, 1, 0, -1,
-  -1, 0, 1, 3, 3, 1, 0, -1,
-  -1, 0, 1, 3, 3, 1, 0, -1,
-  -1, 0, 1, 2, 2, 1, 0, -1,
-  -1, 0, 0, 1, 1, 0, 0, -1,
-  -1, 0, 0, 0, 0, 0, 0, -1,
-  -1, 0, 0, -1, -1, 0, 0, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1,
-  -1, -1, -1, -1, -1, -1, -1, -1,
+/*
+ * The thread that calls get_best_move is the main thread; the other search
+ * threads help it in one of two ways.
+ *
+ * LAZY_SMP: helpers search the same position on private copies, starting
+ * at staggered depths. Threads only share the transposition table, so the
+ * helpers' work shows up as hash hits and better move ordering for the
+ * main thread.
+ *
+ * SPLIT_POINTS: young brothers wait. Once the first move of a node has
+ * been searched, the remaining moves are put up for idle threads to take,
+ * one at a time. Threads working at a split point share its bounds, and
+ * a beta cutoff there aborts everything still searching below it.
+ */
+
+struct split_point {
+	struct split_point *parent;	/* split point above this one */
+	struct board_state state;	/* position at the node */
+	int side;
+	int depth;
+	int ply;
+	int in_check;
+
+	/* protected by search.lock */
+	int alpha;
+	int beta;
+	int best_score;
+	union move *best_move;
+	union move *next_move;		/* moves not taken yet */
+	int *next_score;
+	int num_moves;
+	int move_number;		/* moves taken so far */
+	int num_workers;		/* threads here, besides the master */
+	volatile int cut;		/* beta cutoff, abandon the node */
+};
+
+/* per thread search state */
+struct search_thread {
+	int id;				/* 0 is the main thread */
+	pthread_t thread;
+	struct board_state state;	/* lazy SMP helpers search on a copy */
+	int side;
+	int max_depth;
+	unsigned long nodes;
+	unsigned long qnodes;
+	unsigned long cutoffs;
+	unsigned long first_move_cutoffs;
+	unsigned long tt_probes;
+	unsigned long tt_hits;
+	int aborted;			/* ran out of time, stopped or cut */
+	struct split_point *split;	/* innermost split point we work at */
+	unsigned char no_null_move[MAX_PLY + 1];
+
+	/* move ordering */
+	unsigned killers[MAX_PLY][NUM_KILLERS];
+	int history[NUM_SQUARE_PIECES][BLEVELS][BAREA];
 };
 
+/* state of the search in progress */
+static struct {
+	long start_msecs;
+	long max_msecs;			/* 0 for no time limit */
+	unsigned long max_nodes;	/* 0 for no node limit */
+	unsigned features;		/* enum search_feature bits */
+
+	/* multi-PV: root moves left out of the main thread's search */
+	unsigned excluded[MAX_SEARCH_LINES];
+	int num_excluded;
+	int can_abort;			/* not during the first iteration */
+	volatile int stop;		/* main thread done, helpers quit */
+	int pondering;			/* no time limit until ponder hit */
+
+	/* requests from outside, kept until the search ends */
+	volatile int stop_requested;
+	volatile long ponder_hit_msecs;
+	void (*poll)(void);		/* checks for requests */
+	void (*report)(const struct search_stats *, const union move *);
+	int num_threads;
+	enum parallel_search parallel_search;
+	struct search_thread *threads;
+
+	/* split points open for idle threads */
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;	/* split point opened or finished */
+	struct split_point *splits[MAX_SPLIT_POINTS];
+	int num_splits;
+	int num_idle;
+
+	struct search_stats stats;	/* of the last search */
+} search;
+
+static long
+get_msecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec*1000L + tv.tv_usec/1000L;
+}
+
+static long
+search_elapsed_msecs(void)
+{
+	return get_msecs() - search.start_msecs;
+}
+
+/*
+ * count_search_nodes --
+ *	Nodes searched so far by the first num_threads threads. Counts of
+ *	running helpers are read without locking, which is good enough for
+ *	statistics and node limits.
+ */
+static unsigned long
+count_search_nodes(int num_threads)
+{
+	unsigned long nodes;
+	int i;
+
+	nodes = 0;
+
+	for (i = 0; i < num_threads; i++)
+		nodes += search.threads[i].nodes;
+
+	return nodes;
+}
+
+/*
+ * poll_requests --
+ *	Look for stop and ponder hit requests. On a ponder hit, the clock
+ *	starts running for the search in progress.
+ */
+static void
+poll_requests(void)
+{
+	if (search.poll != NULL)
+		search.poll();
+
+	if (search.pondering && search.ponder_hit_msecs != 0) {
+		search.start_msecs = get_msecs();
+		search.max_msecs = search.ponder_hit_msecs;
+		search.pondering = 0;
+	}
+}
+
+static void
+check_time(struct search_thread *t)
+{
+	/* the main thread may be waiting on helpers at a split point */
+	if (t->id != 0) {
+		if (search.stop || search.stop_requested)
+			t->aborted = 1;
+		return;
+	}
+
+	poll_requests();
+
+	if (search.stop_requested || (!search.pondering && search.can_abort &&
+	  ((search.max_msecs > 0 &&
+	    search_elapsed_msecs() >= search.max_msecs) ||
+	   (search.max_nodes > 0 &&
+	    count_search_nodes(search.num_threads) >= search.max_nodes)))) {
+		t->aborted = 1;
+		search.stop = 1;
+	}
+}
+
 static int
-get_score_for_board(const struct board_state *state, struct position *first,
-  int size)
+is_cut(const struct split_point *sp)
 {
-	int i, j, s;
-	int square, score;
-	const unsigned char *board;
+	for (; sp != NULL; sp = sp->parent) {
+		if (sp->cut)
+			return 1;
+	}
 
-	score = 0;
+	return 0;
+}
 
-	board = state->board[first->level];
-	square = first->square;
+static void
+count_node(struct search_thread *t)
+{
+	if ((++t->nodes & (CHECK_TIME_INTERVAL - 1)) == 0)
+		check_time(t);
 
-	for (i = 0; i < size; i++) {
-		for (j = 0; j < size; j++) {
-			s = board[square];
+	if (t->split != NULL && is_cut(t->split))
+		t->aborted = 1;
+}
 
-			if (s != EMPTY) {
-				if (s & BLACK_FLAG)
-					score -= square_scores[square];
-				else
-					score += square_scores[square];
-			}
+/*
+ * Transposition table. Each bucket fills a 64-byte cache line and holds
+ * TT_BUCKET_SIZE entries. An entry stores its key xor'ed with its data,
+ * so a torn or colliding entry simply fails to match.
+ */
+
+enum {
+	TT_BUCKET_SIZE = 4,
+	TT_DEFAULT_BITS = 18,		/* 2^18 buckets, 16 MB */
+	CACHE_LINE_SIZE = 64,
+};
+
+enum tt_bound {
+	TT_UPPER = 1,			/* score <= stored score */
+	TT_LOWER = 2,			/* score >= stored score */
+	TT_EXACT = TT_UPPER|TT_LOWER,
+};
+
+/*
+ * entry data layout:
+ *	bits 0-23	packed best move (0 = none)
+ *	bits 24-31	depth
+ *	bits 32-33	bound
+ *	bits 34-39	generation
+ *	bits 40-63	score (signed)
+ */
+#define TT_MOVE(data) ((unsigned)((data) & 0xffffffULL))
+#define TT_DEPTH(data) ((int)(((data) >> 24) & 0xff))
+#define TT_BOUND(data) ((int)(((data) >> 32) & 3))
+#define TT_GENERATION(data) ((int)(((data) >> 34) & 63))
+#define TT_SCORE(data) ((int)((long long)(data) >> 40))
+
+struct tt_entry {
+	unsigned long long key;		/* hash key ^ data */
+	unsigned long long data;
+};
+
+struct tt_bucket {
+	struct tt_entry entries[TT_BUCKET_SIZE];
+};
 
-			++square;
+static struct tt_bucket *tt_buckets;
+static unsigned long tt_mask;
+static int tt_generation;
+
+static void
+tt_init(int bits)
+{
+	static void *tt_mem;
+
+	free(tt_mem);
+
+	if ((tt_mem = calloc((1UL << bits) + 1, sizeof *tt_buckets)) == NULL) {
+		fprintf(stderr, "couldn't allocate transposition table: %s\n",
+		  strerror(errno));
+		exit(1);
+	}
+
+	/* align buckets to cache lines */
+	tt_buckets = (struct tt_bucket *)
+	  (((unsigned long)tt_mem + CACHE_LINE_SIZE - 1) &
+	    ~(unsigned long)(CACHE_LINE_SIZE - 1));
+
+	tt_mask = (1UL << bits) - 1;
+	tt_generation = 0;
+}
+
+/* mate scores are stored relative to the node, not to the root */
+
+static int
+score_to_tt(int score, int ply)
+{
+	if (score > MATE_SCORE - MAX_PLY)
+		return score + ply;
+	else if (score < -MATE_SCORE + MAX_PLY)
+		return score - ply;
+	else
+		return score;
+}
+
+static int
+score_from_tt(int score, int ply)
+{
+	if (score > MATE_SCORE - MAX_PLY)
+		return score - ply;
+	else if (score < -MATE_SCORE + MAX_PLY)
+		return score + ply;
+	else
+		return score;
+}
+
+/*
+ * tt_probe --
+ *	Return the data for key, or 0 if it isn't in the table.
+ */
+static unsigned long long
+tt_probe(unsigned long long key)
+{
+	struct tt_entry *p, *end;
+	unsigned long long data;
+
+	p = tt_buckets[key & tt_mask].entries;
+	end = p + TT_BUCKET_SIZE;
+
+	for (; p != end; p++) {
+		data = p->data;
+
+		if ((p->key ^ data) == key)
+			return data;
+	}
+
+	return 0ULL;
+}
+
+static void
+tt_store(unsigned long long key, int depth, enum tt_bound bound, int score,
+  unsigned move)
+{
+	struct tt_entry *p, *end, *victim;
+	unsigned long long data;
+	int victim_value, value;
+
+	p = tt_buckets[key & tt_mask].entries;
+	end = p + TT_BUCKET_SIZE;
+
+	victim = NULL;
+	victim_value = INT_MAX;
+
+	for (; p != end; p++) {
+		data = p->data;
+
+		if ((p->key ^ data) == key) {
+			/* keep the old best move if we don't have one */
+			if (move == 0)
+				move = TT_MOVE(data);
+
+			victim = p;
+			break;
 		}
 
-		square += BCOLS - size;
+		/* replace stale entries first, then the shallowest */
+		value = TT_DEPTH(data);
+		if (TT_GENERATION(data) != tt_generation)
+			value -= 256;
+
+		if (value < victim_value) {
+			victim_value = value;
+			victim = p;
+		}
 	}
 
-	return score;
+	data = (unsigned long long)move|
+	  ((unsigned long long)depth << 24)|
+	  ((unsigned long long)bound << 32)|
+	  ((unsigned long long)tt_generation << 34)|
+	  ((unsigned long long)score << 40);
+
+	victim->key = key ^ data;
+	victim->data = data;
 }
 
 static int
 get_score(const struct board_state *state, int side)
 {
-	int i, j;
-	struct position first;
 	int score;
 
-	score = state->material_imbalance;
+	score = state->material_imbalance + state->positional_score;
 
-	for (i = 0; i < NUM_MAIN_BOARDS; i++) {
-		get_main_board_position(&first, i);
+	return score*(side == BLACK_FLAG ? -1 : 1);
+}
 
-		score += get_score_for_board(state, &first, MAIN_BOARD_SIZE);
+/*
+ * Move ordering. Moves are picked lazily, best first: the hash move, then
+ * captures (most valuable victim, least valuable attacker), then the two
+ * killer moves for the ply, then the remaining moves by history score.
+ * In the main search they're also generated lazily, in that order (see
+ * get_next_move).
+ */
 
-		for (j = 0; j < 8; j++) {
-			if (ATTACK_BOARD_IS_ACTIVE(state, i, j)) {
-				get_attack_board_position(&first, i, j);
+enum {
+	HASH_MOVE_SCORE = 1 << 30,
+	CAPTURE_SCORE = 1 << 28,
+	KILLER_SCORE = 1 << 26,
+};
 
-				score += get_score_for_board(state, &first,
-				  ATTACK_BOARD_SIZE);
-			}
-		}
+/* least valuable attacker first */
+static const int attacker_rank[NUM_PIECES] = {
+	5,	/* pawn */
+	2,	/* rook */
+	4,	/* knight */
+	3,	/* bishop */
+	1,	/* queen */
+	0,	/* king */
+};
+
+/*
+ * history_slot --
+ *	History counter for a quiet move: indexed by the moving piece and
+ *	the destination square. Attack board moves use the top left square
+ *	of the destination and an empty piece.
+ */
+static int *
+history_slot(struct search_thread *t, const struct board_state *state,
+  const union move *move, int side)
+{
+	const struct piece_move *pm;
+	const struct attack_board *to;
+	struct position pos;
+
+	switch (move->type) {
+		case PIECE_MOVE:
+			pm = &move->piece_move;
+
+			return &t->history[BOARD_SQUARE(state, pm->from.level,
+			  pm->from.square) & (BLACK_FLAG|PIECE_MASK)]
+			    [pm->to.level][pm->to.square];
+
+		case ATTACK_BOARD_MOVE:
+			to = &move->attack_board_move.to;
+			get_attack_board_position(&pos, to->main_board,
+			  to->position);
+
+			return &t->history[EMPTY][pos.level][pos.square];
+
+		default:
+			/* castling */
+			return &t->history[side|KING][0][move->type];
 	}
+}
 
-	return score*(side == BLACK_FLAG ? -1 : 1);
+static int
+is_capture(const struct board_state *state, const union move *move)
+{
+	const struct position *to;
+
+	if (move->type != PIECE_MOVE)
+		return 0;
+
+	to = &move->piece_move.to;
+
+	return BOARD_SQUARE(state, to->level, to->square) != EMPTY;
 }
 
 static void
-rank_moves(int *rank, const struct board_state *state, union move *moves,
-  int num_moves)
+score_moves(struct search_thread *t, int *scores,
+  const struct board_state *state, const union move *moves, int num_moves,
+  int side, int ply, unsigned hash_move)
 {
 	int i;
-	const union move *end;
+	unsigned packed;
+	const union move *p;
+	const unsigned *killers;
+	const struct position *from, *to;
 
-	end = &moves[num_moves];
+	killers = t->killers[ply];
 
 	for (i = 0; i < num_moves; i++) {
-		const union move *p = &moves[i];
+		p = &moves[i];
+		packed = pack_move(p);
 
-		rank[i] = 0;
+		if (packed == hash_move) {
+			scores[i] = HASH_MOVE_SCORE;
+		} else if (is_capture(state, p)) {
+			from = &p->piece_move.from;
+			to = &p->piece_move.to;
 
-		if (p->type == PIECE_MOVE) {
-			const struct position *to = &p->piece_move.to;
-			const int s = state->board[to->level][to->square];
-
-			if (s != EMPTY)
-				rank[i] = piece_values[(s & PIECE_MASK) - PAWN];
+			scores[i] = CAPTURE_SCORE +
+			  8*piece_values[(BOARD_SQUARE(state, to->level,
+			    to->square) & PIECE_MASK) - PAWN] +
+			  attacker_rank[(BOARD_SQUARE(state, from->level,
+			    from->square) & PIECE_MASK) - PAWN];
+		} else if (packed == killers[0]) {
+			scores[i] = KILLER_SCORE + 1;
+		} else if (packed == killers[1]) {
+			scores[i] = KILLER_SCORE;
+		} else {
+			scores[i] = *history_slot(t, state, p, side);
 		}
 	}
 }
 
+/*
+ * pick_next_move --
+ *	Swap the best scored move among moves[0..num_moves-1] to the front.
+ */
 static void
-best_move_first(int *rank, union move *moves, int num_moves)
+pick_next_move(int *scores, union move *moves, int num_moves)
 {
-	int best_rank, best_move;
-	int i;
+	int i, best, ts;
+	union move tm;
 
-	best_rank = rank[0];
-	best_move = 0;
+	best = 0;
 
-	for (i = 1; i < num_moves; i++)
-		if (rank[i] > best_rank)
-			best_move = i;
+	for (i = 1; i < num_moves; i++) {
+		if (scores[i] > scores[best])
+			best = i;
+	}
 
-	if (best_move > 0) {
-		union move tm;
-		int tr;
-		
+	if (best > 0) {
 		tm = moves[0];
-		moves[0] = moves[best_move];
-		moves[best_move] = tm;
+		moves[0] = moves[best];
+		moves[best] = tm;
+
+		ts = scores[0];
+		scores[0] = scores[best];
+		scores[best] = ts;
+	}
+}
+
+static void
+age_history(struct search_thread *t)
+{
+	int *p, *end;
+
+	p = &t->history[0][0][0];
+	end = p + sizeof t->history/sizeof *p;
+
+	for (; p != end; p++)
+		*p /= 2;
+}
+
+/*
+ * update_quiet_cutoff --
+ *	A quiet move caused a beta cutoff: make it a killer for this ply and
+ *	reward it in the history table.
+ */
+static void
+update_quiet_cutoff(struct search_thread *t, const struct board_state *state,
+  const union move *move, int side, int depth, int ply)
+{
+	unsigned packed;
+	unsigned *killers;
+	int *h;
+
+	packed = pack_move(move);
+	killers = t->killers[ply];
 
-		tr = rank[0];
-		rank[0] = rank[best_move];
-		rank[best_move] = tr;
+	if (killers[0] != packed) {
+		killers[1] = killers[0];
+		killers[0] = packed;
 	}
+
+	h = history_slot(t, state, move, side);
+
+	if ((*h += (depth + 1)*(depth + 1)) >= MAX_HISTORY_SCORE)
+		age_history(t);
 }
 
+/*
+ * quiesce --
+ *	Search captures only (or all moves, when in check) past the
+ *	horizon, so that leaf scores aren't taken in the middle of an
+ *	exchange. The side to move may "stand pat" on the static score.
+ */
 static int
-get_best_move_r(union move *move, struct board_state *state, int side,
-  int depth, int alpha, int beta)
+quiesce(struct search_thread *t, struct board_state *state, int side, int ply,
+  int alpha, int beta)
 {
 	union move moves[MAX_MOVES];
-	int move_rank[MAX_MOVES], *r;
-	union move *best_move;
+	int move_scores[MAX_MOVES], *r;
 	union move *p;
 	const union move *end;
-	int n, score, best_score;
-	union move next_move;
+	const struct position *to;
+	int n, in_check, score, best_score, stand_pat;
 	struct undo_move_info undo_info;
 
-	best_score = -INFINITY;
-	best_move = NULL;
+	if (ply >= MAX_PLY - 1)
+		return get_score(state, side);
 
-	n = get_legal_moves(moves, state, side);
+	in_check = is_in_check(state, side);
+
+	if (in_check) {
+		stand_pat = -INFINITY;
+		best_score = -INFINITY;
+
+		if ((n = get_legal_moves(moves, state, side)) == 0)
+			return -MATE_SCORE + ply;
+	} else {
+		stand_pat = get_score(state, side);
+
+		if (stand_pat >= beta)
+			return stand_pat;
+
+		if (stand_pat > alpha)
+			alpha = stand_pat;
 
-	rank_moves(move_rank, state, moves, n);
+		best_score = stand_pat;
 
-	r = move_rank;
+		n = get_legal_captures(moves, state, side);
+	}
+
+	score_moves(t, move_scores, state, moves, n, side, ply, 0);
+
+	r = move_scores;
 	end = &moves[n];
 
-	for (p = moves; p != end; p++) {
-		best_move_first(r, p, n);
+	for (p = moves; p != end; p++, r++, n--) {
+		pick_next_move(r, p, n);
 
-		do_move(state, p, &undo_info);
+		/*
+		 * delta pruning: skip captures that can't bring the score
+		 * up to alpha even if the piece is won for free (pawn
+		 * captures may promote, so they're always tried)
+		 */
+		if (!in_check && p->type == PIECE_MOVE &&
+		  (search.features & DELTA_PRUNING)) {
+			const struct position *from = &p->piece_move.from;
 
-		if (depth == 0) {
-			score = get_score(state, side);
-		} else {
-			score = -get_best_move_r(&next_move,
-			  state, side^BLACK_FLAG, depth - 1,
-			  -beta, -alpha);
+			to = &p->piece_move.to;
+
+			if ((BOARD_SQUARE(state, from->level, from->square) &
+			  PIECE_MASK) != PAWN &&
+			  stand_pat + DELTA_MARGIN +
+			    piece_values[(BOARD_SQUARE(state, to->level,
+			      to->square) & PIECE_MASK) - PAWN] <= alpha)
+				continue;
 		}
 
+		count_node(t);
+		t->qnodes++;
+
+		do_move(state, p, &undo_info);
+		score = -quiesce(t, state, side^BLACK_FLAG, ply + 1, -beta,
+		  -alpha);
 		undo_move(state, &undo_info);
 
+		if (t->aborted)
+			return 0;
+
 		if (score > best_score) {
 			best_score = score;
-			best_move = p;
-		
+
 			if (best_score > alpha)
 				alpha = best_score;
 
 			if (best_score >= beta)
 				break;
 		}
-
-		n--;
-		r++;
 	}
 
-	if (best_move != NULL)
-		*move = *best_move;
-
 	return best_score;
 }
 
-void
-get_best_move(union move *move, struct board_state *state, int side,
-  int max_depth)
+static int
+get_best_move_r(struct search_thread *t, union move *move,
+  struct board_state *state, int side, int depth, int ply, int alpha,
+  int beta);
+
+/*
+ * late_move_reduction --
+ *	How many plies less to search a move with ordering score
+ *	move_score, after move_number moves at the node: only late quiet
+ *	moves are reduced.
+ */
+static int
+late_move_reduction(int depth, int move_number, int move_score, int in_check)
+{
+	if (in_check || depth < LMR_MIN_DEPTH || move_number < LMR_MIN_MOVES ||
+	  move_score >= KILLER_SCORE ||
+	  !(search.features & LATE_MOVE_REDUCTIONS))
+		return 0;
+
+	return move_number >= LMR_LATE_MOVES && depth > LMR_MIN_DEPTH ? 2 : 1;
+}
+
+/*
+ * split_point_alpha --
+ *	Alpha for another search of a move at split point sp: sp's own, if
+ *	other threads have raised it past alpha (and it hasn't reached
+ *	beta, which cuts the node off anyway).
+ */
+static int
+split_point_alpha(struct split_point *sp, int alpha)
+{
+	if (sp == NULL)
+		return alpha;
+
+	pthread_mutex_lock(&search.lock);
+
+	if (sp->alpha > alpha && sp->alpha < sp->beta)
+		alpha = sp->alpha;
+
+	pthread_mutex_unlock(&search.lock);
+
+	return alpha;
+}
+
+/*
+ * search_move --
+ *	Score of a move at a node: the first move gets the full window,
+ *	the others principal variation search, that is, a null window to
+ *	prove that the move is no better than the best so far, and the
+ *	full window again if it turns out to be. A move may first be
+ *	searched reduction plies shallower (unless it gives check), and
+ *	searched again to full depth if it beats alpha. At a split point
+ *	(sp not NULL), each search after the first takes alpha from sp,
+ *	which other threads may have raised meanwhile.
+ */
+static int
+search_move(struct search_thread *t, struct board_state *state,
+  const union move *move, int side, int depth, int ply, int alpha, int beta,
+  int is_first, int reduction, struct split_point *sp)
 {
+	union move next_move;
+	struct undo_move_info undo_info;
 	int score;
 
-	score = get_best_move_r(move, state, side, max_depth, -INFINITY,
-	  INFINITY);
+	do_move(state, move, &undo_info);
+
+	if (is_first) {
+		score = -get_best_move_r(t, &next_move, state,
+		  side^BLACK_FLAG, depth - 1, ply + 1, -beta, -alpha);
+	} else {
+		score = alpha + 1;
+
+		if (reduction > 0 && !is_in_check(state, side^BLACK_FLAG)) {
+			score = -get_best_move_r(t, &next_move, state,
+			  side^BLACK_FLAG, depth - 1 - reduction, ply + 1,
+			  -alpha - 1, -alpha);
+		}
+
+		if (score > alpha && !t->aborted) {
+			alpha = split_point_alpha(sp, alpha);
+			score = -get_best_move_r(t, &next_move, state,
+			  side^BLACK_FLAG, depth - 1, ply + 1, -alpha - 1,
+			  -alpha);
+		}
+
+		if (score > alpha && score < beta && !t->aborted) {
+			alpha = split_point_alpha(sp, alpha);
+			score = -get_best_move_r(t, &next_move, state,
+			  side^BLACK_FLAG, depth - 1, ply + 1, -beta, -alpha);
+		}
+	}
+
+	undo_move(state, &undo_info);
 
-	assert(score > INT_MIN);
-	fprintf(stderr, "score: %d\n", score);
+	return score;
 }
 
-void
-init_engine(void)
+/*
+ * work_at_split_point --
+ *	Take moves from a split point and search them, until there are none
+ *	left or the node is cut off.
+ */
+static void
+work_at_split_point(struct search_thread *t, struct split_point *sp,
+  struct board_state *state)
+{
+	union move *p;
+	int alpha, score, reduction;
+
+	pthread_mutex_lock(&search.lock);
+
+	while (sp->num_moves > 0 && !sp->cut && !t->aborted) {
+		pick_next_move(sp->next_score, sp->next_move, sp->num_moves);
+
+		reduction = late_move_reduction(sp->depth, sp->move_number,
+		  *sp->next_score, sp->in_check);
+
+		p = sp->next_move++;
+		sp->next_score++;
+		sp->num_moves--;
+		sp->move_number++;
+
+		alpha = sp->alpha;
+
+		pthread_mutex_unlock(&search.lock);
+
+		count_node(t);
+
+		score = search_move(t, state, p, sp->side, sp->depth, sp->ply,
+		  alpha, sp->beta, 0, reduction, sp);
+
+		pthread_mutex_lock(&search.lock);
+
+		if (t->aborted)
+			break;
+
+		if (score > sp->best_score) {
+			sp->best_score = score;
+			sp->best_move = p;
+
+			if (score > sp->alpha)
+				sp->alpha = score;
+
+			if (score >= sp->beta) {
+				sp->cut = 1;
+				t->cutoffs++;
+
+				if (!is_capture(state, p))
+					update_quiet_cutoff(t, state, p,
+					  sp->side, sp->depth, sp->ply);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&search.lock);
+}
+
+static int
+is_below(const struct split_point *sp, const struct split_point *top)
+{
+	for (; sp != NULL; sp = sp->parent) {
+		if (sp == top)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * find_split_point --
+ *	Open split point with the deepest subtrees left, or NULL. If below
+ *	is not NULL, only split points under it are considered. Called with
+ *	search.lock held.
+ */
+static struct split_point *
+find_split_point(const struct split_point *below)
+{
+	struct split_point *sp, *best;
+	int i;
+
+	best = NULL;
+
+	for (i = 0; i < search.num_splits; i++) {
+		sp = search.splits[i];
+
+		if (sp->num_moves > 0 && !sp->cut &&
+		  (below == NULL || is_below(sp, below)) &&
+		  (best == NULL || sp->depth > best->depth))
+			best = sp;
+	}
+
+	return best;
+}
+
+/*
+ * idle_loop --
+ *	Join open split points as they come up. Helper threads stay here
+ *	until the search is stopped. A master waiting for the other threads
+ *	at its split point (waiting) only helps below it, and returns as
+ *	soon as they are done.
+ */
+static void
+idle_loop(struct search_thread *t, struct split_point *waiting)
 {
+	struct split_point *sp, *prev_split;
+	struct board_state board;
+
+	prev_split = t->split;
+
+	pthread_mutex_lock(&search.lock);
+
+	while (waiting != NULL ? waiting->num_workers > 0 : !search.stop) {
+		if ((sp = find_split_point(waiting)) == NULL) {
+			++search.num_idle;
+			pthread_cond_wait(&search.work_cond, &search.lock);
+			--search.num_idle;
+			continue;
+		}
+
+		++sp->num_workers;
+
+		pthread_mutex_unlock(&search.lock);
+
+		board = sp->state;
+
+		t->split = sp;
+		t->aborted = search.stop || search.stop_requested;
+
+		work_at_split_point(t, sp, &board);
+
+		t->split = prev_split;
+		t->aborted = search.stop || search.stop_requested ||
+		  is_cut(prev_split);
+
+		pthread_mutex_lock(&search.lock);
+
+		if (--sp->num_workers == 0)
+			pthread_cond_broadcast(&search.work_cond);
+	}
+
+	pthread_mutex_unlock(&search.lock);
+}
+
+/*
+ * search_split_point --
+ *	Open a split point for idle threads, and work at it until all its
+ *	moves have been searched. Returns 0 if there's no room for another
+ *	split point.
+ */
+static int
+search_split_point(struct search_thread *t, struct split_point *sp,
+  struct board_state *state)
+{
+	int i;
+
+	sp->parent = t->split;
+	sp->num_workers = 0;
+	sp->cut = 0;
+
+	pthread_mutex_lock(&search.lock);
+
+	if (search.num_splits == MAX_SPLIT_POINTS) {
+		pthread_mutex_unlock(&search.lock);
+		return 0;
+	}
+
+	sp->state = *state;
+
+	search.splits[search.num_splits++] = sp;
+	pthread_cond_broadcast(&search.work_cond);
+
+	pthread_mutex_unlock(&search.lock);
+
+	t->split = sp;
+
+	work_at_split_point(t, sp, state);
+
+	/* close it, then wait for (and help) the threads still at it */
+
+	pthread_mutex_lock(&search.lock);
+
+	for (i = 0; search.splits[i] != sp; i++)
+		;
+	search.splits[i] = search.splits[--search.num_splits];
+
+	pthread_mutex_unlock(&search.lock);
+
+	idle_loop(t, sp);
+
+	t->split = sp->parent;
+	t->aborted = search.stop || search.stop_requested ||
+	  is_cut(sp->parent);
+
+	return 1;
+}
+
+static int
+can_split(const struct search_thread *t, int depth)
+{
+	return search.parallel_search == SPLIT_POINTS &&
+	  depth >= MIN_SPLIT_DEPTH && search.num_idle > 0 && !t->aborted;
+}
+
+/*
+ * exclude_root_moves --
+ *	Take the root moves already ranked by a multi-PV search out of
+ *	moves. Returns how many are left.
+ */
+static int
+exclude_root_moves(union move *moves, int n)
+{
+	unsigned packed;
+	int i, j;
+
+	for (i = 0; i < n; ) {
+		packed = pack_move(&moves[i]);
+
+		for (j = 0; j < search.num_excluded; j++) {
+			if (search.excluded[j] == packed)
+				break;
+		}
+
+		if (j < search.num_excluded)
+			moves[i] = moves[--n];
+		else
+			i++;
+	}
+
+	return n;
+}
+
+/*
+ * Staged move generation. Most nodes are cut off by one of their first
+ * moves, so the moves of a node are generated a stage at a time, each
+ * when the ones before it are used up: the hash move, the captures, the
+ * killer moves, the other piece moves, and last the attack board moves,
+ * the most expensive to generate (each one is tried on the board to see
+ * that it doesn't leave the king in check).
+ */
+
+enum move_stage {
+	HASH_MOVE_STAGE,
+	CAPTURES_STAGE,
+	KILLERS_STAGE,
+	QUIET_MOVES_STAGE,
+	ATTACK_BOARD_MOVES_STAGE,
+	NO_MOVES_LEFT,
+};
+
+struct move_picker {
+	struct search_thread *t;
+	struct board_state *state;
+	int side;
+	int ply;
+	int excluding;			/* leave out search.excluded */
+	enum move_stage stage;		/* next stage to generate */
+	unsigned hash_move;
+	unsigned picked[1 + NUM_KILLERS]; /* hash move and killers found */
+	int num_picked;
+
+	/* the stages may generate the hash move and killers again */
+	union move moves[MAX_MOVES + 1 + NUM_KILLERS];
+	int scores[MAX_MOVES + 1 + NUM_KILLERS];
+	int num_moves;			/* generated so far */
+	int next;			/* first one not returned yet */
+};
+
+static void
+init_move_picker(struct move_picker *mp, struct search_thread *t,
+  struct board_state *state, int side, int ply, unsigned hash_move,
+  int excluding)
+{
+	mp->t = t;
+	mp->state = state;
+	mp->side = side;
+	mp->ply = ply;
+	mp->excluding = excluding;
+	mp->stage = HASH_MOVE_STAGE;
+	mp->hash_move = hash_move;
+	mp->num_picked = 0;
+	mp->num_moves = 0;
+	mp->next = 0;
+}
+
+/*
+ * add_picked_move --
+ *	Add the hash move or a killer, if it's legal here.
+ */
+static void
+add_picked_move(struct move_picker *mp, unsigned packed, int score)
+{
+	union move *p;
+
+	p = &mp->moves[mp->num_moves];
+	unpack_move(p, packed);
+
+	/* a killer that captures here was added with the captures */
+	if (score < HASH_MOVE_SCORE && is_capture(mp->state, p))
+		return;
+
+	if (!is_valid_move(p, mp->state, mp->side) ||
+	  (mp->excluding && exclude_root_moves(p, 1) == 0))
+		return;
+
+	mp->picked[mp->num_picked++] = packed;
+	mp->scores[mp->num_moves++] = score;
+}
+
+/*
+ * add_moves --
+ *	Score the n moves just generated past the others, leaving out the
+ *	ones added before.
+ */
+static void
+add_moves(struct move_picker *mp, int n)
+{
+	union move *first, *p;
+	const union move *end;
+	unsigned packed;
+	int i;
+
+	first = p = &mp->moves[mp->num_moves];
+	end = &first[n];
+
+	for (; p != end; p++) {
+		packed = pack_move(p);
+
+		for (i = 0; i < mp->num_picked; i++) {
+			if (mp->picked[i] == packed)
+				break;
+		}
+
+		if (i < mp->num_picked)
+			*p-- = *--end;
+	}
+
+	n = end - first;
+
+	if (mp->excluding)
+		n = exclude_root_moves(first, n);
+
+	score_moves(mp->t, &mp->scores[mp->num_moves], mp->state, first, n,
+	  mp->side, mp->ply, 0);
+
+	mp->num_moves += n;
+}
+
+static void
+generate_next_stage(struct move_picker *mp)
+{
+	union move *end;
+	const unsigned *killers;
+	int i;
+
+	end = &mp->moves[mp->num_moves];
+
+	switch (mp->stage++) {
+		case HASH_MOVE_STAGE:
+			if (mp->hash_move != 0)
+				add_picked_move(mp, mp->hash_move,
+				  HASH_MOVE_SCORE);
+			break;
+
+		case CAPTURES_STAGE:
+			add_moves(mp, get_legal_captures(end, mp->state,
+			  mp->side));
+			break;
+
+		case KILLERS_STAGE:
+			killers = mp->t->killers[mp->ply];
+
+			for (i = 0; i < NUM_KILLERS; i++) {
+				if (killers[i] != 0 &&
+				  killers[i] != mp->hash_move)
+					add_picked_move(mp, killers[i],
+					  KILLER_SCORE + NUM_KILLERS - 1 - i);
+			}
+			break;
+
+		case QUIET_MOVES_STAGE:
+			add_moves(mp, get_legal_quiet_moves(end, mp->state,
+			  mp->side));
+			break;
+
+		case ATTACK_BOARD_MOVES_STAGE:
+			add_moves(mp, get_legal_attack_board_moves(end,
+			  mp->state, mp->side));
+			break;
+
+		default:
+			assert(0);
+	}
+}
+
+/*
+ * get_next_move --
+ *	The best move left, generating the next stages as needed, or NULL
+ *	if there are none.
+ */
+static union move *
+get_next_move(struct move_picker *mp)
+{
+	while (mp->next == mp->num_moves) {
+		if (mp->stage == NO_MOVES_LEFT)
+			return NULL;
+
+		generate_next_stage(mp);
+	}
+
+	pick_next_move(&mp->scores[mp->next], &mp->moves[mp->next],
+	  mp->num_moves - mp->next);
+
+	return &mp->moves[mp->next++];
+}
+
+/*
+ * generate_all_moves --
+ *	Generate the stages left (to hand the moves to a split point).
+ *	Returns the number of moves not returned yet.
+ */
+static int
+generate_all_moves(struct move_picker *mp)
+{
+	while (mp->stage != NO_MOVES_LEFT)
+		generate_next_stage(mp);
+
+	return mp->num_moves - mp->next;
+}
+
+static int
+get_best_move_r(struct search_thread *t, union move *move,
+  struct board_state *state, int side, int depth, int ply, int alpha,
+  int beta)
+{
+	struct move_picker mp;
+	union move *best_move;
+	union move *p;
+	int move_number, score, best_score, orig_alpha;
+	int in_check, allow_null_move, excluding;
+	unsigned long long key, tt_data;
+	unsigned hash_move;
+	struct split_point sp;
+	union move next_move;
+
+	allow_null_move = !t->no_null_move[ply];
+	t->no_null_move[ply] = 0;
+
+	if (depth < 0)
+		return quiesce(t, state, side, ply, alpha, beta);
+
+	key = HASH_KEY(state, side);
+	hash_move = 0;
+
+	t->tt_probes++;
+
+	if ((tt_data = tt_probe(key)) != 0ULL) {
+		t->tt_hits++;
+		hash_move = TT_MOVE(tt_data);
+
+		if (ply > 0 && TT_DEPTH(tt_data) >= depth) {
+			score = score_from_tt(TT_SCORE(tt_data), ply);
+
+			switch (TT_BOUND(tt_data)) {
+				case TT_EXACT:
+					return score;
+
+				case TT_LOWER:
+					if (score >= beta)
+						return score;
+					break;
+
+				case TT_UPPER:
+					if (score <= alpha)
+						return score;
+					break;
+			}
+		}
+	}
+
+	in_check = is_in_check(state, side);
+
+	/*
+	 * null move pruning: if passing and searching the reply to reduced
+	 * depth still fails high, assume some real move would too. Not in
+	 * check, not twice in a row, and not at nodes with a full window.
+	 * Deep cutoffs are verified with a reduced search of our own moves,
+	 * which catches zugzwang.
+	 */
+	if (allow_null_move && (search.features & NULL_MOVE_PRUNING) &&
+	  !in_check && ply > 0 &&
+	  depth >= NULL_MOVE_MIN_DEPTH && beta - alpha == 1 &&
+	  beta < MATE_SCORE - MAX_PLY && get_score(state, side) >= beta) {
+		t->no_null_move[ply + 1] = 1;
+
+		score = -get_best_move_r(t, &next_move, state, side^BLACK_FLAG,
+		  depth - 1 - NULL_MOVE_REDUCTION, ply + 1, -beta, -beta + 1);
+
+		if (t->aborted)
+			return 0;
+
+		if (score >= beta && depth >= NULL_MOVE_VERIFY_DEPTH) {
+			t->no_null_move[ply] = 1;
+
+			score = get_best_move_r(t, &next_move, state, side,
+			  depth - 1 - NULL_MOVE_REDUCTION, ply, beta - 1, beta);
+
+			if (t->aborted)
+				return 0;
+		}
+
+		if (score >= beta)
+			return score >= MATE_SCORE - MAX_PLY ? beta : score;
+	}
+
+	orig_alpha = alpha;
+
+	best_score = -INFINITY;
+	best_move = NULL;
+
+	excluding = ply == 0 && t->id == 0 && search.num_excluded > 0;
+
+	init_move_picker(&mp, t, state, side, ply, hash_move, excluding);
+
+	while ((p = get_next_move(&mp)) != NULL) {
+		move_number = p - mp.moves;
+
+		count_node(t);
+
+		score = search_move(t, state, p, side, depth, ply, alpha, beta,
+		  move_number == 0, late_move_reduction(depth, move_number,
+		    mp.scores[move_number], in_check), NULL);
+
+		if (t->aborted)
+			return 0;
+
+		if (score > best_score) {
+			best_score = score;
+			best_move = p;
+		
+			if (best_score > alpha)
+				alpha = best_score;
+
+			if (best_score >= beta) {
+				t->cutoffs++;
+
+				if (move_number == 0)
+					t->first_move_cutoffs++;
+
+				if (!is_capture(state, p))
+					update_quiet_cutoff(t, state, p, side,
+					  depth, ply);
+				break;
+			}
+		}
+
+		/* young brothers wait: share the rest after the first move */
+		if (move_number == 0 && can_split(t, depth) &&
+		  generate_all_moves(&mp) > 1) {
+			sp.side = side;
+			sp.depth = depth;
+			sp.ply = ply;
+			sp.in_check = in_check;
+			sp.alpha = alpha;
+			sp.beta = beta;
+			sp.best_score = best_score;
+			sp.best_move = best_move;
+			sp.next_move = &mp.moves[mp.next];
+			sp.next_score = &mp.scores[mp.next];
+			sp.num_moves = mp.num_moves - mp.next;
+			sp.move_number = 1;
+
+			if (search_split_point(t, &sp, state)) {
+				if (t->aborted)
+					return 0;
+
+				best_score = sp.best_score;
+				best_move = sp.best_move;
+				break;
+			}
+		}
+	}
+
+	/* no legal moves */
+	if (best_move == NULL)
+		return -MATE_SCORE + ply;
+
+	*move = *best_move;
+
+	/* the score of some of the moves isn't the score of the position */
+	if (!excluding) {
+		tt_store(key, depth,
+		  best_score >= beta ? TT_LOWER :
+		    best_score > orig_alpha ? TT_EXACT : TT_UPPER,
+		  score_to_tt(best_score, ply), pack_move(best_move));
+	}
+
+	return best_score;
+}
+
+/*
+ * search_root --
+ *	Search with an aspiration window around the score of the previous
+ *	iteration, widening the window on the side that fails.
+ */
+static int
+search_root(struct search_thread *t, union move *move,
+  struct board_state *state, int side, int depth, int prev_score)
+{
+	int score, alpha, beta, delta;
+
+	if (depth < MIN_ASPIRATION_DEPTH ||
+	  !(search.features & ASPIRATION_WINDOWS)) {
+		alpha = -INFINITY;
+		beta = INFINITY;
+	} else {
+		alpha = prev_score - ASPIRATION_WINDOW;
+		beta = prev_score + ASPIRATION_WINDOW;
+	}
+
+	delta = ASPIRATION_WINDOW;
+
+	for (;;) {
+		score = get_best_move_r(t, move, state, side, depth, 0, alpha,
+		  beta);
+
+		if (t->aborted)
+			break;
+
+		delta *= 4;
+
+		if (score <= alpha) {
+			alpha = score - delta;
+			if (alpha < -INFINITY)
+				alpha = -INFINITY;
+		} else if (score >= beta) {
+			beta = score + delta;
+			if (beta > INFINITY)
+				beta = INFINITY;
+		} else {
+			break;
+		}
+	}
+
+	return score;
+}
+
+static int
+is_mate_score(int score)
+{
+	return score > MATE_SCORE - MAX_PLY || score < -MATE_SCORE + MAX_PLY;
+}
+
+static void
+reset_search_thread(struct search_thread *t)
+{
+	t->nodes = 0;
+	t->qnodes = 0;
+	t->cutoffs = 0;
+	t->first_move_cutoffs = 0;
+	t->tt_probes = 0;
+	t->tt_hits = 0;
+	t->aborted = 0;
+	t->split = NULL;
+
+	memset(t->killers, 0, sizeof t->killers);
+	age_history(t);
+}
+
+/*
+ * helper_main --
+ *	Helper search thread. With split points, it just works at the split
+ *	points opened by the other threads. With lazy SMP, it runs its own
+ *	iterative deepening on a private copy of the position until the
+ *	main thread is done; odd helpers start one ply deeper, so that the
+ *	threads don't all search the same tree.
+ */
+static void *
+helper_main(void *arg)
+{
+	struct search_thread *t = arg;
+	union move move;
+	int depth, score;
+
+	if (search.parallel_search == SPLIT_POINTS) {
+		idle_loop(t, NULL);
+		return NULL;
+	}
+
+	score = 0;
+
+	for (depth = 1 + t->id%2; depth <= t->max_depth; depth++) {
+		score = search_root(t, &move, &t->state, t->side, depth,
+		  score);
+
+		if (t->aborted || is_mate_score(score))
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * finish_search_stats --
+ *	Add up the counters of the threads that took part in the search,
+ *	and log them.
+ */
+static void
+finish_search_stats(int num_threads, int depth, int score)
+{
+	struct search_stats *stats = &search.stats;
+	const struct search_thread *t;
+	unsigned long last, prev;
+	int i, k;
+
+	stats->depth = depth;
+	stats->score = score;
+	stats->msecs = search_elapsed_msecs();
+
+	for (i = 0; i < num_threads; i++) {
+		t = &search.threads[i];
+
+		stats->nodes += t->nodes;
+		stats->qnodes += t->qnodes;
+		stats->cutoffs += t->cutoffs;
+		stats->first_move_cutoffs += t->first_move_cutoffs;
+		stats->tt_probes += t->tt_probes;
+		stats->tt_hits += t->tt_hits;
+	}
+
+	stats->nps = stats->msecs > 0 ? stats->nodes*1000/stats->msecs : 0;
+
+	/* nodes of the last iteration over nodes of the one before it */
+	if ((k = stats->num_iterations) >= 2) {
+		last = stats->iteration_nodes[k - 1] -
+		  stats->iteration_nodes[k - 2];
+		prev = stats->iteration_nodes[k - 2] -
+		  (k >= 3 ? stats->iteration_nodes[k - 3] : 0);
+
+		if (prev > 0)
+			stats->branching_factor = (float)last/prev;
+	}
+
+	fprintf(stderr, "depth: %d, score: %d, nodes: %lu, msecs: %ld\n",
+	  stats->depth, stats->score, stats->nodes, stats->msecs);
+
+	fprintf(stderr, "quiescence nodes: %lu, nps: %lu, cutoffs: %lu "
+	  "(%lu on first move), tt hits: %lu of %lu, branching factor: "
+	  "%.2f\n", stats->qnodes, stats->nps, stats->cutoffs,
+	  stats->first_move_cutoffs, stats->tt_hits, stats->tt_probes,
+	  stats->branching_factor);
+
+	fprintf(stderr, "iteration msecs:");
+
+	for (i = 0; i < stats->num_iterations; i++)
+		fprintf(stderr, " %ld", stats->iteration_msecs[i]);
+
+	fprintf(stderr, "\n");
+}
+
+/*
+ * get_pv --
+ *	Fill in the principal variation of line, which starts with its root
+ *	move, by following the best moves in the transposition table, up to
+ *	max_length moves.
+ */
+static void
+get_pv(struct search_line *line, const struct board_state *root, int side,
+  int max_length)
+{
+	struct board_state state;
+	struct undo_move_info undo_info;
+	union move moves[MAX_MOVES];
+	unsigned long long tt_data;
+	unsigned packed;
+	int i, n;
+
+	if (max_length > MAX_PV_LENGTH)
+		max_length = MAX_PV_LENGTH;
+
+	state = *root;
+
+	do_move(&state, &line->pv[0], &undo_info);
+	side ^= BLACK_FLAG;
+	line->pv_length = 1;
+
+	while (line->pv_length < max_length &&
+	  (tt_data = tt_probe(HASH_KEY(&state, side))) != 0ULL &&
+	  (packed = TT_MOVE(tt_data)) != 0) {
+		n = get_legal_moves(moves, &state, side);
+
+		for (i = 0; i < n; i++) {
+			if (pack_move(&moves[i]) == packed)
+				break;
+		}
+
+		if (i == n)
+			break;
+
+		line->pv[line->pv_length++] = moves[i];
+		do_move(&state, &moves[i], &undo_info);
+		side ^= BLACK_FLAG;
+	}
+}
+
+/* best first; lines with the same score keep their order */
+static void
+sort_lines(struct search_line *lines, int num_lines)
+{
+	struct search_line line;
+	int i, j;
+
+	for (i = 1; i < num_lines; i++) {
+		line = lines[i];
+
+		for (j = i; j > 0 && lines[j - 1].score < line.score; j--)
+			lines[j] = lines[j - 1];
+
+		lines[j] = line;
+	}
+}
+
+/*
+ * search_position --
+ *	Iterative deepening: search to depth 0, 1, ... max_depth, until
+ *	max_msecs milliseconds (if not 0) have passed. With more than one
+ *	line (multi-PV), every iteration searches the root once per line,
+ *	each time leaving out the root moves of the lines found before, so
+ *	all of them get exact scores. The lines from the last completed
+ *	iteration are returned in lines, best first. Returns the depth of
+ *	that iteration, or -1 if the search was stopped during the first
+ *	(and lines are empty).
+ */
+static int
+search_position(struct search_line *lines, int num_lines,
+  struct board_state *state, int side, int max_depth, long max_msecs)
+{
+	int i, k, depth, completed_depth, num_helpers, all_mates, err;
+	struct search_line iteration_lines[MAX_SEARCH_LINES];
+	struct search_thread *t, *h;
+
+	tt_generation = (tt_generation + 1) & 63;
+
+	memset(&search.stats, 0, sizeof search.stats);
+
+	search.start_msecs = get_msecs();
+	search.max_msecs = max_msecs;
+	search.can_abort = 0;
+	search.stop = 0;
+	search.num_splits = 0;
+
+	t = &search.threads[0];
+	reset_search_thread(t);
+
+	/* start helpers */
+
+	for (num_helpers = 0; num_helpers < search.num_threads - 1;
+	  num_helpers++) {
+		h = &search.threads[num_helpers + 1];
+
+		reset_search_thread(h);
+		h->state = *state;
+		h->side = side;
+		h->max_depth = max_depth;
+
+		err = pthread_create(&h->thread, NULL, helper_main, h);
+
+		if (err != 0) {
+			fprintf(stderr, "couldn't start search thread: %s\n",
+			  strerror(err));
+			break;
+		}
+	}
+
+	for (k = 0; k < num_lines; k++) {
+		lines[k].score = 0;
+		lines[k].pv_length = 0;
+	}
+
+	completed_depth = -1;
+
+	for (depth = 0; depth <= max_depth; depth++) {
+		/* always finish the first iteration, so we have a move */
+		search.can_abort = depth > 0;
+
+		for (k = 0; k < num_lines; k++) {
+			search.num_excluded = k;
+
+			iteration_lines[k].score = search_root(t,
+			  &iteration_lines[k].pv[0], state, side, depth,
+			  lines[k].score);
+
+			if (t->aborted)
+				break;
+
+			search.excluded[k] =
+			  pack_move(&iteration_lines[k].pv[0]);
+		}
+
+		search.num_excluded = 0;
+
+		if (t->aborted)
+			break;
+
+		sort_lines(iteration_lines, num_lines);
+
+		for (k = 0; k < num_lines; k++) {
+			get_pv(&iteration_lines[k], state, side, depth + 1);
+			lines[k] = iteration_lines[k];
+		}
+
+		completed_depth = depth;
+
+		if (depth < MAX_STATS_ITERATIONS) {
+			search.stats.iteration_msecs[depth] =
+			  search_elapsed_msecs();
+			search.stats.iteration_nodes[depth] =
+			  count_search_nodes(num_helpers + 1);
+			search.stats.num_iterations = depth + 1;
+		}
+
+		if (search.report != NULL) {
+			search.stats.depth = depth;
+			search.stats.score = lines[0].score;
+			search.stats.msecs = search_elapsed_msecs();
+			search.stats.nodes = count_search_nodes(num_helpers + 1);
+			search.stats.nps = search.stats.msecs > 0 ?
+			  search.stats.nodes*1000/search.stats.msecs : 0;
+			search.report(&search.stats, &lines[0].pv[0]);
+			search.stats.nodes = 0;
+		}
+
+		/* found forced mates (or mated) for all lines? */
+		all_mates = 1;
+
+		for (k = 0; k < num_lines; k++) {
+			if (!is_mate_score(lines[k].score))
+				all_mates = 0;
+		}
+
+		if (all_mates)
+			break;
+
+		poll_requests();
+
+		/* next iteration is unlikely to finish in the time left */
+		if (!search.pondering && search.max_msecs > 0 &&
+		  search_elapsed_msecs() >= search.max_msecs/2)
+			break;
+
+		if (!search.pondering && search.max_nodes > 0 &&
+		  count_search_nodes(num_helpers + 1) >= search.max_nodes)
+			break;
+	}
+
+	/* stop helpers */
+
+	pthread_mutex_lock(&search.lock);
+	search.stop = 1;
+	pthread_cond_broadcast(&search.work_cond);
+	pthread_mutex_unlock(&search.lock);
+
+	for (i = 1; i <= num_helpers; i++)
+		pthread_join(search.threads[i].thread, NULL);
+
+	finish_search_stats(num_helpers + 1, completed_depth, lines[0].score);
+
+	return completed_depth;
+}
+
+/*
+ * get_fallback_move --
+ *	A move for a search that didn't complete an iteration: the best
+ *	move in the transposition table if it has one, or else the first
+ *	legal move.
+ */
+static void
+get_fallback_move(union move *move, struct board_state *state, int side)
+{
+	union move moves[MAX_MOVES];
+	unsigned long long tt_data;
+	unsigned packed;
+	int i, n;
+
+	n = get_legal_moves(moves, state, side);
+
+	assert(n > 0);
+
+	*move = moves[0];
+
+	if ((tt_data = tt_probe(HASH_KEY(state, side))) == 0ULL ||
+	  (packed = TT_MOVE(tt_data)) == 0)
+		return;
+
+	for (i = 0; i < n; i++) {
+		if (pack_move(&moves[i]) == packed) {
+			*move = moves[i];
+			return;
+		}
+	}
+}
+
+/*
+ * get_best_move --
+ *	Search for the best move for side, to max_depth plies or for
+ *	max_msecs milliseconds (if not 0), whichever comes first, or
+ *	until stop_search is called ("move now"), in which case the best
+ *	move found so far is returned. Book moves are played without
+ *	searching. Returns the score of the move for side.
+ */
+int
+get_best_move(union move *move, struct board_state *state, int side,
+  int max_depth, long max_msecs)
+{
+	struct search_line line;
+	int score;
+
+	if (book_probe(move, &score, state, side)) {
+		fprintf(stderr, "book move, score: %d\n", score);
+		memset(&search.stats, 0, sizeof search.stats);
+		return score;
+	}
+
+	search.pondering = 0;
+
+	if (search_position(&line, 1, state, side, max_depth, max_msecs) < 0) {
+		/* stopped right away: take what the table has, if anything */
+		line.score = 0;
+		get_fallback_move(&line.pv[0], state, side);
+	}
+
+	*move = line.pv[0];
+
+	search.stop_requested = 0;
+
+	return line.score;
+}
+
+/*
+ * get_best_lines --
+ *	Search like get_best_move, but rank the best num_lines root moves
+ *	(at most MAX_SEARCH_LINES), each with its exact score and principal
+ *	variation, into lines, best first. The book isn't used. Returns the
+ *	number of lines, which is less than num_lines if there aren't that
+ *	many legal moves, and 0 if the search was stopped before it had any.
+ */
+int
+get_best_lines(struct search_line *lines, int num_lines,
+  struct board_state *state, int side, int max_depth, long max_msecs)
+{
+	union move moves[MAX_MOVES];
+	int n, completed_depth;
+
+	n = get_legal_moves(moves, state, side);
+
+	if (num_lines > n)
+		num_lines = n;
+
+	if (num_lines > MAX_SEARCH_LINES)
+		num_lines = MAX_SEARCH_LINES;
+
+	if (num_lines <= 0)
+		return 0;
+
+	search.pondering = 0;
+
+	completed_depth = search_position(lines, num_lines, state, side,
+	  max_depth, max_msecs);
+
+	search.stop_requested = 0;
+
+	return completed_depth >= 0 ? num_lines : 0;
+}
+
+/*
+ * get_search_stats --
+ *	Statistics of the last search, all zero if the last move came from
+ *	the book.
+ */
+void
+get_search_stats(struct search_stats *stats)
+{
+	*stats = search.stats;
+}
+
+/*
+ * get_ponder_position --
+ *	Play move on state, then the reply we expect from the opponent
+ *	(the best move the transposition table has for it). Returns 0 if
+ *	there's no such reply.
+ */
+int
+get_ponder_position(struct board_state *state, int side,
+  const union move *move)
+{
+	union move moves[MAX_MOVES];
+	struct undo_move_info undo_info;
+	unsigned long long tt_data;
+	unsigned packed;
+	int i, n;
+
+	do_move(state, move, &undo_info);
+	side ^= BLACK_FLAG;
+
+	if ((tt_data = tt_probe(HASH_KEY(state, side))) == 0ULL ||
+	  (packed = TT_MOVE(tt_data)) == 0)
+		return 0;
+
+	n = get_legal_moves(moves, state, side);
+
+	for (i = 0; i < n; i++) {
+		if (pack_move(&moves[i]) == packed) {
+			do_move(state, &moves[i], &undo_info);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * ponder --
+ *	Search on the opponent's time, with no time limit, until
+ *	ponder_hit or stop_search is called. After a ponder hit, the search
+ *	goes on as get_best_move would, stop_search included ("move now"),
+ *	and 1 is returned with the move. If stopped before a ponder hit,
+ *	returns 0.
+ */
+int
+ponder(union move *move, struct board_state *state, int side, int max_depth)
+{
+	struct search_line line;
+	int completed_depth, hit;
+
+	search.pondering = 1;
+
+	completed_depth = search_position(&line, 1, state, side, max_depth,
+	  0);
+
+	if (completed_depth >= 0)
+		*move = line.pv[0];
+
+	/* went as deep as we could before the opponent moved */
+	while (search.pondering && !search.stop_requested) {
+		usleep(PONDER_WAIT_USECS);
+		poll_requests();
+	}
+
+	/* the opponent played the move, and we're playing ours now */
+	hit = search.ponder_hit_msecs != 0;
+
+	if (hit && completed_depth < 0)
+		get_fallback_move(move, state, side);
+
+	search.pondering = 0;
+	search.stop_requested = 0;
+	search.ponder_hit_msecs = 0;
+
+	return hit;
+}
+
+/*
+ * ponder_hit --
+ *	The opponent played the expected move: the ponder search becomes
+ *	a regular one, with max_msecs milliseconds from now on. May be
+ *	called from another thread.
+ */
+void
+ponder_hit(long max_msecs)
+{
+	search.ponder_hit_msecs = max_msecs > 0 ? max_msecs : 1;
+}
+
+/*
+ * stop_search --
+ *	Abort the search in progress (or the next one, if none is) as soon
+ *	as possible, which is within CHECK_TIME_INTERVAL nodes of the main
+ *	search thread. get_best_move then returns the best move found so
+ *	far. May be called from another thread.
+ */
+void
+stop_search(void)
+{
+	search.stop_requested = 1;
+}
+
+/*
+ * clear_stop_search --
+ *	Forget a stop_search request that came too late for the search it
+ *	was meant for, so it doesn't stop the next one. May be called from
+ *	another thread, which has to make sure no search is running.
+ */
+void
+clear_stop_search(void)
+{
+	search.stop_requested = 0;
+}
+
+/*
+ * set_search_poll --
+ *	Have the search call poll every few thousand nodes, so that it can
+ *	check for ponder_hit and stop_search requests from the same thread.
+ */
+void
+set_search_poll(void (*poll)(void))
+{
+	search.poll = poll;
+}
+
+/*
+ * set_search_node_limit --
+ *	Stop searches (other than ponder searches before the ponder hit)
+ *	after about max_nodes nodes, as if they ran out of time. 0 for no
+ *	limit.
+ */
+void
+set_search_node_limit(unsigned long max_nodes)
+{
+	search.max_nodes = max_nodes;
+}
+
+/*
+ * set_search_features --
+ *	Turn parts of the search on or off; features is a set of enum
+ *	search_feature bits. Everything is on after init_engine.
+ */
+void
+set_search_features(unsigned features)
+{
+	search.features = features;
+}
+
+/*
+ * set_search_report --
+ *	Have the main search thread call report after every completed
+ *	iteration, with the depth, score, nodes, msecs and nps so far and
+ *	the best move.
+ */
+void
+set_search_report(void (*report)(const struct search_stats *stats,
+  const union move *move))
+{
+	search.report = report;
+}
+
+/*
+ * init_engine --
+ *	Allocate the transposition table, and the state for num_threads
+ *	search threads, which split the work as parallel_search says.
+ */
+void
+init_engine(int num_threads, enum parallel_search parallel_search)
+{
+	int i;
+
+	tt_init(TT_DEFAULT_BITS);
+
+	if (num_threads < 1)
+		num_threads = 1;
+	else if (num_threads > MAX_SEARCH_THREADS)
+		num_threads = MAX_SEARCH_THREADS;
+
+	free(search.threads);
+
+	if ((search.threads = calloc(num_threads,
+	  sizeof *search.threads)) == NULL) {
+		fprintf(stderr, "couldn't allocate search threads: %s\n",
+		  strerror(errno));
+		exit(1);
+	}
+
+	for (i = 0; i < num_threads; i++)
+		search.threads[i].id = i;
+
+	search.num_threads = num_threads;
+	search.parallel_search = parallel_search;
+	search.features = ALL_SEARCH_FEATURES;
+
+	pthread_mutex_init(&search.lock, NULL);
+	pthread_cond_init(&search.work_cond, NULL);
 }
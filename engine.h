@@ -13,11 +13,94 @@
 #ifndef ENGINE_H_
 #define ENGINE_H_
 
-void
+/* how search threads share the work */
+enum parallel_search {
+	LAZY_SMP,			/* shared transposition table only */
+	SPLIT_POINTS			/* young brothers wait */
+};
+
+/* parts of the search that can be turned off, to measure what they do */
+enum search_feature {
+	NULL_MOVE_PRUNING = 1,
+	LATE_MOVE_REDUCTIONS = 2,
+	ASPIRATION_WINDOWS = 4,
+	DELTA_PRUNING = 8,
+	ALL_SEARCH_FEATURES = 15
+};
+
+enum {
+	MAX_SEARCH_DEPTH = 100,		/* no depth limit */
+	MAX_STATS_ITERATIONS = 32,
+	MAX_SEARCH_LINES = 16,		/* multi-PV */
+	MAX_PV_LENGTH = 32,
+};
+
+/* a root move with its exact score and principal variation */
+struct search_line {
+	int score;
+	int pv_length;
+	union move pv[MAX_PV_LENGTH];	/* pv[0] is the root move */
+};
+
+/* what the last search did */
+struct search_stats {
+	int depth;			/* of the last completed iteration */
+	int score;
+	long msecs;
+	unsigned long nodes;
+	unsigned long qnodes;		/* of which in quiescence search */
+	unsigned long nps;
+	unsigned long cutoffs;		/* beta cutoffs after trying moves */
+	unsigned long first_move_cutoffs;
+	unsigned long tt_probes;
+	unsigned long tt_hits;
+	float branching_factor;		/* effective, of the last iteration */
+	int num_iterations;
+	long iteration_msecs[MAX_STATS_ITERATIONS];	/* time to finish */
+	unsigned long iteration_nodes[MAX_STATS_ITERATIONS];
+};
+
+int
 get_best_move(union move *move, struct board_state *state, int side,
-  int max_depth);
+  int max_depth, long max_msecs);
+
+int
+get_best_lines(struct search_line *lines, int num_lines,
+  struct board_state *state, int side, int max_depth, long max_msecs);
+
+int
+get_ponder_position(struct board_state *state, int side,
+  const union move *move);
+
+int
+ponder(union move *move, struct board_state *state, int side, int max_depth);
+
+void
+ponder_hit(long max_msecs);
+
+void
+get_search_stats(struct search_stats *stats);
+
+void
+stop_search(void);
+
+void
+clear_stop_search(void);
+
+void
+set_search_poll(void (*poll)(void));
+
+void
+set_search_node_limit(unsigned long max_nodes);
+
+void
+set_search_features(unsigned features);
+
+void
+set_search_report(void (*report)(const struct search_stats *stats,
+  const union move *move));
 
 void
-init_engine(void);
+init_engine(int num_threads, enum parallel_search parallel_search);
 
 #endif /* ENGINE_H_ */
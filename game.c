@@ -26,9 +26,27 @@ const int piece_values[NUM_PIECES] = {
 	30000,	/* king */
 };
 
-static struct board_state initial_board_state = {
-	/* board */
-  { { INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
+/* positional bonus for a piece on a square, whatever the level */
+static const int square_scores[BAREA] = {
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, 0, 0, -1, -1, 0, 0, -1,
+  -1, 0, 0, 0, 0, 0, 0, -1,
+  -1, 0, 0, 1, 1, 0, 0, -1,
+  -1, 0, 1, 2, 2, 1, 0, -1,
+  -1, 0, 1, 3, 3, 1, 0, -1,
+  -1, 0, 1, 3, 3, 1, 0, -1,
+  -1, 0, 1, 2, 2, 1, 0, -1,
+  -1, 0, 0, 1, 1, 0, 0, -1,
+  -1, 0, 0, 0, 0, 0, 0, -1,
+  -1, 0, 0, -1, -1, 0, 0, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/* level by level, copied into the board by init_board_state */
+static const unsigned char initial_board[BLEVELS][BAREA] = {
+  { INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
       INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
       INVALID, BLACK_ROOK, BLACK_QUEEN, INVALID, INVALID, BLACK_KING, BLACK_ROOK, INVALID,
       INVALID, BLACK_PAWN, BLACK_PAWN, EMPTY, EMPTY, BLACK_PAWN, BLACK_PAWN, INVALID, 
@@ -131,7 +149,11 @@ static struct board_state initial_board_state = {
       INVALID, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, INVALID,
       INVALID, EMPTY, EMPTY, INVALID, INVALID, EMPTY, EMPTY, INVALID,
       INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID,
-      INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID } },
+      INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID, INVALID } };
+
+static struct board_state initial_board_state = {
+	/* board (filled in by init_board_state) */
+	{ EMPTY },
 
 	/* attack board flags */
 	(1UL<<AB_ABOVE_LEFT_UP)|(1UL<<(AB_ABOVE_RIGHT_UP))|
@@ -143,14 +165,212 @@ static struct board_state initial_board_state = {
 	/* material imbalance */
 	0,
 
+	/* positional score (computed in init_board_state) */
+	0,
+
 	/* castling rights */
 	CR_WHITE_KINGSIDE|CR_WHITE_QUEENSIDE|
 	CR_BLACK_KINGSIDE|CR_BLACK_QUEENSIDE,
 
 	/* cur ply */
 	0,
+
+	/* hash (computed in init_board_state) */
+	0ULL,
+
+	/* kings */
+	{ { 4, 11*BCOLS + 5 }, { 0, 2*BCOLS + 5 } },
+
+	/* occupancy (computed in init_board_state) */
+	0ULL,
+};
+
+enum {
+	NUM_SQUARE_STATES = 32,		/* piece|BLACK_FLAG|MOVED_FLAG */
+	NUM_ATTACK_BOARD_BITS = 8*NUM_MAIN_BOARDS,
 };
 
+/* zobrist keys */
+static unsigned long long square_hash_keys[BLEVELS][BAREA][NUM_SQUARE_STATES];
+static unsigned long long attack_board_hash_keys[NUM_ATTACK_BOARD_BITS];
+static unsigned long long attack_board_side_hash_keys[NUM_ATTACK_BOARD_BITS];
+static unsigned long long castling_hash_keys[16];
+unsigned long long black_to_move_hash_key;
+
+/*
+ * next_hash_key --
+ *	Fixed-seed 64-bit generator (splitmix64), so that keys (and anything
+ *	stored with them) are the same on every run.
+ */
+static unsigned long long
+next_hash_key(unsigned long long *seed)
+{
+	unsigned long long z;
+
+	z = (*seed += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+void
+init_hash_keys(void)
+{
+	int i, j, k;
+	unsigned long long seed;
+
+	seed = 0x76756c63616eULL;
+
+	for (i = 0; i < BLEVELS; i++) {
+		for (j = 0; j < BAREA; j++) {
+			square_hash_keys[i][j][EMPTY] = 0ULL;
+
+			for (k = 1; k < NUM_SQUARE_STATES; k++)
+				square_hash_keys[i][j][k] =
+				  next_hash_key(&seed);
+		}
+	}
+
+	for (i = 0; i < NUM_ATTACK_BOARD_BITS; i++) {
+		attack_board_hash_keys[i] = next_hash_key(&seed);
+		attack_board_side_hash_keys[i] = next_hash_key(&seed);
+	}
+
+	for (i = 0; i < 16; i++)
+		castling_hash_keys[i] = next_hash_key(&seed);
+
+	black_to_move_hash_key = next_hash_key(&seed);
+}
+
+static unsigned long long
+attack_board_bits_hash(unsigned bits, const unsigned long long *keys)
+{
+	unsigned long long hash;
+	int i;
+
+	hash = 0ULL;
+
+	for (i = 0; bits; i++, bits >>= 1) {
+		if (bits & 1)
+			hash ^= keys[i];
+	}
+
+	return hash;
+}
+
+/*
+ * get_board_hash --
+ *	Compute zobrist key of a position from scratch. do_move keeps
+ *	state->hash up to date incrementally.
+ */
+static unsigned long long
+get_board_hash(const struct board_state *state)
+{
+	int i, j;
+	unsigned char s;
+	unsigned long long hash;
+
+	hash = 0ULL;
+
+	for (i = 0; i < BLEVELS; i++) {
+		for (j = 0; j < BAREA; j++) {
+			s = BOARD_SQUARE(state, i, j);
+
+			if (s != EMPTY && s != INVALID)
+				hash ^= square_hash_keys[i][j][s];
+		}
+	}
+
+	hash ^= attack_board_bits_hash(state->attack_board_bits,
+	  attack_board_hash_keys);
+	hash ^= attack_board_bits_hash(state->attack_board_side,
+	  attack_board_side_hash_keys);
+	hash ^= castling_hash_keys[state->castling_rights];
+
+	return hash;
+}
+
+static int
+get_square_score(unsigned char s, int square)
+{
+	if (s == EMPTY || s == INVALID)
+		return 0;
+	else if (s & BLACK_FLAG)
+		return -square_scores[square];
+	else
+		return square_scores[square];
+}
+
+/*
+ * get_board_positional_score --
+ *	Compute positional score of a position from scratch. do_move keeps
+ *	state->positional_score up to date incrementally.
+ */
+static int
+get_board_positional_score(const struct board_state *state)
+{
+	int i, j, score;
+
+	score = 0;
+
+	for (i = 0; i < BLEVELS; i++) {
+		for (j = 0; j < BAREA; j++)
+			score += get_square_score(BOARD_SQUARE(state, i, j), j);
+	}
+
+	return score;
+}
+
+/*
+ * update_piece_bits --
+ *	s was or is on some level of square: update its bit in the piece
+ *	bits.
+ */
+static void
+update_piece_bits(struct board_state *state, int square, int s)
+{
+	if (s == EMPTY)
+		return;
+
+	if (has_piece_at(state, square, s & ~MOVED_FLAG))
+		PIECE_BITS(state, s & BLACK_FLAG, s & PIECE_MASK) |=
+		  SQUARE_BIT(square);
+	else
+		PIECE_BITS(state, s & BLACK_FLAG, s & PIECE_MASK) &=
+		  ~SQUARE_BIT(square);
+}
+
+/*
+ * init_occupancy --
+ *	Compute the occupancy and the piece bits from scratch. do_move keeps
+ *	them up to date incrementally.
+ */
+static void
+init_occupancy(struct board_state *state)
+{
+	int i, j, k, square;
+
+	state->occupancy = 0ULL;
+	memset(state->piece_bits, 0, sizeof state->piece_bits);
+
+	for (i = 2; i < BROWS - 2; i++) {
+		for (j = 1; j < BCOLS - 1; j++) {
+			square = i*BCOLS + j;
+
+			if (BOARD_SQUARE(state, 0, square) == INVALID)
+				continue;
+
+			for (k = 0; k < BLEVELS; k++)
+				update_piece_bits(state, square,
+				  BOARD_SQUARE(state, k, square));
+
+			if (!square_is_empty(state, square))
+				state->occupancy |= SQUARE_BIT(square);
+		}
+	}
+}
+
 static void
 init_undo_info(struct undo_move_info *undo_info,
   const struct board_state *state)
@@ -159,7 +379,228 @@ init_undo_info(struct undo_move_info *undo_info,
 	undo_info->prev_attack_board_bits = state->attack_board_bits;
 	undo_info->prev_attack_board_side = state->attack_board_side;
 	undo_info->prev_material_imbalance = state->material_imbalance;
+	undo_info->prev_positional_score = state->positional_score;
 	undo_info->prev_castling_rights = state->castling_rights;
+	undo_info->prev_hash = state->hash;
+	undo_info->prev_king_pos[0] = state->king_pos[0];
+	undo_info->prev_king_pos[1] = state->king_pos[1];
+	undo_info->prev_pieces_in_play[0] = state->pieces_in_play[0];
+	undo_info->prev_pieces_in_play[1] = state->pieces_in_play[1];
+	undo_info->prev_occupancy = state->occupancy;
+	memcpy(undo_info->prev_piece_bits, state->piece_bits,
+	  sizeof state->piece_bits);
+}
+
+/*
+ * init_piece_lists --
+ *	Build the piece lists from scratch. do_move keeps them up to date
+ *	incrementally.
+ */
+static void
+init_piece_lists(struct board_state *state)
+{
+	int i, j, s, slot;
+	struct position *pos;
+
+	state->pieces_in_play[0] = state->pieces_in_play[1] = 0;
+
+	for (i = 0; i < BLEVELS; i++) {
+		for (j = 0; j < BAREA; j++) {
+			s = BOARD_SQUARE(state, i, j);
+
+			if (s == EMPTY || s == INVALID)
+				continue;
+
+			for (slot = 0; PIECES_IN_PLAY(state, s & BLACK_FLAG) &
+			  (1U << slot); slot++)
+				;
+
+			assert(slot < MAX_PIECES_PER_SIDE);
+
+			pos = &PIECES(state, s & BLACK_FLAG)[slot];
+			pos->level = i;
+			pos->square = j;
+
+			state->piece_slot[i][j] = slot;
+			PIECES_IN_PLAY(state, s & BLACK_FLAG) |= 1U << slot;
+		}
+	}
+}
+
+/*
+ * move_piece_slot --
+ *	The piece of side on from moved to to.
+ */
+static void
+move_piece_slot(struct board_state *state, int side,
+  const struct position *from, const struct position *to)
+{
+	int slot;
+
+	slot = state->piece_slot[from->level][from->square];
+
+	PIECES(state, side)[slot] = *to;
+	state->piece_slot[to->level][to->square] = slot;
+}
+
+/*
+ * castle_piece_slots --
+ *	The king and rook of side moved, on level. Their squares may be
+ *	swapped.
+ */
+static void
+castle_piece_slots(struct board_state *state, int side, int level,
+  int king_from, int king_to, int rook_from, int rook_to)
+{
+	int king_slot, rook_slot;
+
+	king_slot = state->piece_slot[level][king_from];
+	rook_slot = state->piece_slot[level][rook_from];
+
+	PIECES(state, side)[king_slot].square = king_to;
+	PIECES(state, side)[rook_slot].square = rook_to;
+
+	state->piece_slot[level][king_to] = king_slot;
+	state->piece_slot[level][rook_to] = rook_slot;
+}
+
+/*
+ * update_piece_lists --
+ *	Called by do_move after the squares touched by the move are
+ *	recorded in undo_info.
+ */
+static void
+update_piece_lists(struct board_state *state, const union move *move,
+  struct undo_move_info *undo_info)
+{
+	const struct position *touched;
+	int i, s;
+
+	touched = undo_info->squares_touched;
+
+	for (i = 0; i < undo_info->num_squares_touched; i++) {
+		undo_info->prev_slots[i] =
+		  state->piece_slot[touched[i].level][touched[i].square];
+	}
+
+	switch (move->type) {
+		case PIECE_MOVE:
+			/* from, then to */
+			s = undo_info->prev_states[1];
+
+			if (s != EMPTY) {
+				PIECES_IN_PLAY(state, s & BLACK_FLAG) &=
+				  ~(1U << undo_info->prev_slots[1]);
+			}
+
+			move_piece_slot(state, undo_info->prev_states[0] &
+			  BLACK_FLAG, &touched[0], &touched[1]);
+			break;
+
+		case ATTACK_BOARD_MOVE:
+			/* pairs of from and to squares */
+			for (i = 0; i < undo_info->num_squares_touched;
+			  i += 2) {
+				s = undo_info->prev_states[i];
+
+				if (s != EMPTY)
+					move_piece_slot(state, s & BLACK_FLAG,
+					  &touched[i], &touched[i + 1]);
+			}
+			break;
+
+		case WHITE_KINGSIDE_CASTLING:
+			castle_piece_slots(state, 0, 4, 11*BCOLS + 5,
+			  11*BCOLS + 6, 11*BCOLS + 6, 11*BCOLS + 5);
+			break;
+
+		case WHITE_QUEENSIDE_CASTLING:
+			castle_piece_slots(state, 0, 4, 11*BCOLS + 5,
+			  11*BCOLS + 2, 11*BCOLS + 1, 11*BCOLS + 5);
+			break;
+
+		case BLACK_KINGSIDE_CASTLING:
+			castle_piece_slots(state, BLACK_FLAG, 0, 2*BCOLS + 5,
+			  2*BCOLS + 6, 2*BCOLS + 6, 2*BCOLS + 5);
+			break;
+
+		case BLACK_QUEENSIDE_CASTLING:
+			castle_piece_slots(state, BLACK_FLAG, 0, 2*BCOLS + 5,
+			  2*BCOLS + 2, 2*BCOLS + 1, 2*BCOLS + 5);
+			break;
+	}
+}
+
+static void
+update_hash(struct board_state *state,
+  const struct undo_move_info *undo_info)
+{
+	int i;
+	const struct position *pos;
+	unsigned long long hash;
+
+	hash = state->hash;
+
+	for (i = 0; i < undo_info->num_squares_touched; i++) {
+		pos = &undo_info->squares_touched[i];
+
+		hash ^= square_hash_keys[pos->level][pos->square]
+		    [undo_info->prev_states[i]] ^
+		  square_hash_keys[pos->level][pos->square]
+		    [BOARD_SQUARE(state, pos->level, pos->square)];
+	}
+
+	hash ^= attack_board_bits_hash(
+	  state->attack_board_bits ^ undo_info->prev_attack_board_bits,
+	  attack_board_hash_keys);
+
+	hash ^= attack_board_bits_hash(
+	  state->attack_board_side ^ undo_info->prev_attack_board_side,
+	  attack_board_side_hash_keys);
+
+	hash ^= castling_hash_keys[undo_info->prev_castling_rights] ^
+	  castling_hash_keys[state->castling_rights];
+
+	state->hash = hash;
+}
+
+static void
+update_positional_score(struct board_state *state,
+  const struct undo_move_info *undo_info)
+{
+	int i;
+	const struct position *pos;
+
+	for (i = 0; i < undo_info->num_squares_touched; i++) {
+		pos = &undo_info->squares_touched[i];
+
+		state->positional_score +=
+		  get_square_score(BOARD_SQUARE(state, pos->level, pos->square),
+		    pos->square) -
+		  get_square_score(undo_info->prev_states[i], pos->square);
+	}
+}
+
+static void
+update_occupancy(struct board_state *state,
+  const struct undo_move_info *undo_info)
+{
+	const struct position *pos;
+	int i, s;
+
+	for (i = 0; i < undo_info->num_squares_touched; i++) {
+		pos = &undo_info->squares_touched[i];
+		s = BOARD_SQUARE(state, pos->level, pos->square);
+
+		update_piece_bits(state, pos->square,
+		  undo_info->prev_states[i]);
+		update_piece_bits(state, pos->square, s);
+
+		if (s != EMPTY)
+			state->occupancy |= SQUARE_BIT(pos->square);
+		else if (square_is_empty(state, pos->square))
+			state->occupancy &= ~SQUARE_BIT(pos->square);
+	}
 }
 
 static void
@@ -169,8 +610,8 @@ do_piece_move(struct board_state *state, const struct piece_move *move,
 	unsigned char *from, *to;
 	int piece, side;
 
-	from = &state->board[move->from.level][move->from.square];
-	to = &state->board[move->to.level][move->to.square];
+	from = &BOARD_SQUARE(state, move->from.level, move->from.square);
+	to = &BOARD_SQUARE(state, move->to.level, move->to.square);
 
 	undo_info->num_squares_touched = 2;
 
@@ -192,6 +633,18 @@ do_piece_move(struct board_state *state, const struct piece_move *move,
 		}
 	}
 
+	/* a rook taken before it moved can't castle any more */
+	if ((*to & PIECE_MASK) == ROOK) {
+		if (move->to.level == 0 && move->to.square == 2*BCOLS + 1)
+			state->castling_rights &= ~CR_BLACK_QUEENSIDE;
+		else if (move->to.level == 0 && move->to.square == 2*BCOLS + 6)
+			state->castling_rights &= ~CR_BLACK_KINGSIDE;
+		else if (move->to.level == 4 && move->to.square == 11*BCOLS + 1)
+			state->castling_rights &= ~CR_WHITE_QUEENSIDE;
+		else if (move->to.level == 4 && move->to.square == 11*BCOLS + 6)
+			state->castling_rights &= ~CR_WHITE_KINGSIDE;
+	}
+
 	side = *from & BLACK_FLAG;
 	piece = *from & PIECE_MASK;
 
@@ -273,6 +726,8 @@ do_piece_move(struct board_state *state, const struct piece_move *move,
 		if (promoted)
 			*to = (*to & BLACK_FLAG)|QUEEN;
 	} else if (piece == KING) {
+		KING_POS(state, side) = move->to;
+
 		if (side == BLACK_FLAG) {
 			state->castling_rights &=
 			  ~(CR_BLACK_KINGSIDE|CR_BLACK_QUEENSIDE);
@@ -322,8 +777,8 @@ do_attack_board_move(struct board_state *state,
 	from_square = from_pos.square;
 	to_square = to_pos.square;
 
-	from = &state->board[from_pos.level][from_square];
-	to = &state->board[to_pos.level][to_square];
+	from = &BOARD_SQUARE(state, from_pos.level, from_square);
+	to = &BOARD_SQUARE(state, to_pos.level, to_square);
 
 	touched = undo_info->squares_touched;
 	prev_state = undo_info->prev_states;
@@ -340,17 +795,24 @@ do_attack_board_move(struct board_state *state,
 			++touched;
 			*prev_state++ = *to;
 
-			if (((*to = *from) & PIECE_MASK) == PAWN)
+			if (((*to = *from) & PIECE_MASK) == PAWN) {
 				*to |= MOVED_FLAG;
+			} else if ((*to & PIECE_MASK) == KING) {
+				KING_POS(state, *to & BLACK_FLAG).level =
+				  to_pos.level;
+				KING_POS(state, *to & BLACK_FLAG).square =
+				  to_square;
+			}
+
 			*from = EMPTY;
-			++from;
-			++to;
+			from += BOARD_SQUARE_STRIDE;
+			to += BOARD_SQUARE_STRIDE;
 			++from_square;
 			++to_square;
 		}
 
-		from += BCOLS - ATTACK_BOARD_SIZE;
-		to += BCOLS - ATTACK_BOARD_SIZE;
+		from += (BCOLS - ATTACK_BOARD_SIZE)*BOARD_SQUARE_STRIDE;
+		to += (BCOLS - ATTACK_BOARD_SIZE)*BOARD_SQUARE_STRIDE;
 		from_square += BCOLS - ATTACK_BOARD_SIZE;
 		to_square += BCOLS - ATTACK_BOARD_SIZE;
 	}
@@ -378,8 +840,8 @@ do_attack_board_move(struct board_state *state,
 		state->castling_rights &= ~CR_BLACK_QUEENSIDE;
 	}
 
-	if ((state->castling_rights & CR_BLACK_KINGSIDE) &&
-	  move->from.main_board == 0 &&
+	/* the king's board takes the king along */
+	if (move->from.main_board == 0 &&
 	  move->from.position == AB_ABOVE_RIGHT_UP) {
 		state->castling_rights &=
 		  ~(CR_BLACK_KINGSIDE|CR_BLACK_QUEENSIDE);
@@ -391,8 +853,8 @@ do_attack_board_move(struct board_state *state,
 		state->castling_rights &= ~CR_WHITE_QUEENSIDE;
 	}
 
-	if ((state->castling_rights & CR_WHITE_KINGSIDE) &&
-	  move->from.main_board == 2 &&
+	/* the king's board takes the king along */
+	if (move->from.main_board == 2 &&
 	  move->from.position == AB_ABOVE_RIGHT_DOWN) {
 		state->castling_rights &=
 		  ~(CR_WHITE_KINGSIDE|CR_WHITE_QUEENSIDE);
@@ -426,8 +888,9 @@ do_move(struct board_state *state, const union move *move,
 			undo_info->squares_touched[1].square = 11*BCOLS + 6;
 			undo_info->prev_states[1] = WHITE_ROOK;
 
-			state->board[4][11*BCOLS + 5] = WHITE_ROOK;
-			state->board[4][11*BCOLS + 6] = WHITE_KING;
+			BOARD_SQUARE(state, 4, 11*BCOLS + 5) = WHITE_ROOK;
+			BOARD_SQUARE(state, 4, 11*BCOLS + 6) = WHITE_KING;
+			KING_POS(state, 0).square = 11*BCOLS + 6;
 
 			state->castling_rights &=
 			  ~(CR_WHITE_KINGSIDE|CR_WHITE_QUEENSIDE);
@@ -448,9 +911,10 @@ do_move(struct board_state *state, const union move *move,
 			undo_info->squares_touched[2].square = 11*BCOLS + 1;
 			undo_info->prev_states[2] = WHITE_ROOK;
 
-			state->board[4][11*BCOLS + 5] = WHITE_ROOK;
-			state->board[4][11*BCOLS + 2] = WHITE_KING;
-			state->board[4][11*BCOLS + 1] = EMPTY;
+			BOARD_SQUARE(state, 4, 11*BCOLS + 5) = WHITE_ROOK;
+			BOARD_SQUARE(state, 4, 11*BCOLS + 2) = WHITE_KING;
+			BOARD_SQUARE(state, 4, 11*BCOLS + 1) = EMPTY;
+			KING_POS(state, 0).square = 11*BCOLS + 2;
 
 			state->castling_rights &=
 			  ~(CR_WHITE_KINGSIDE|CR_WHITE_QUEENSIDE);
@@ -467,8 +931,9 @@ do_move(struct board_state *state, const union move *move,
 			undo_info->squares_touched[1].square = 2*BCOLS + 6;
 			undo_info->prev_states[1] = BLACK_ROOK;
 
-			state->board[0][2*BCOLS + 5] = BLACK_ROOK;
-			state->board[0][2*BCOLS + 6] = BLACK_KING;
+			BOARD_SQUARE(state, 0, 2*BCOLS + 5) = BLACK_ROOK;
+			BOARD_SQUARE(state, 0, 2*BCOLS + 6) = BLACK_KING;
+			KING_POS(state, BLACK_FLAG).square = 2*BCOLS + 6;
 
 			state->castling_rights &=
 			  ~(CR_BLACK_KINGSIDE|CR_BLACK_QUEENSIDE);
@@ -489,9 +954,10 @@ do_move(struct board_state *state, const union move *move,
 			undo_info->squares_touched[2].square = 2*BCOLS + 1;
 			undo_info->prev_states[2] = BLACK_ROOK;
 
-			state->board[0][2*BCOLS + 5] = BLACK_ROOK;
-			state->board[0][2*BCOLS + 2] = BLACK_KING;
-			state->board[0][2*BCOLS + 1] = EMPTY;
+			BOARD_SQUARE(state, 0, 2*BCOLS + 5) = BLACK_ROOK;
+			BOARD_SQUARE(state, 0, 2*BCOLS + 2) = BLACK_KING;
+			BOARD_SQUARE(state, 0, 2*BCOLS + 1) = EMPTY;
+			KING_POS(state, BLACK_FLAG).square = 2*BCOLS + 2;
 
 			state->castling_rights &=
 			  ~(CR_BLACK_KINGSIDE|CR_BLACK_QUEENSIDE);
@@ -501,6 +967,11 @@ do_move(struct board_state *state, const union move *move,
 			assert(0);
 	}
 
+	update_piece_lists(state, move, undo_info);
+	update_hash(state, undo_info);
+	update_positional_score(state, undo_info);
+	update_occupancy(state, undo_info);
+
 	state->cur_ply++;
 }
 
@@ -508,18 +979,40 @@ void
 undo_move(struct board_state *state,
   const struct undo_move_info *undo_info)
 {
-	int i;
+	const struct position *touched;
+	int i, s, slot;
+
+	touched = undo_info->squares_touched;
 
 	for (i = 0; i < undo_info->num_squares_touched; i++) {
-		state->board[undo_info->squares_touched[i].level]
-		  [undo_info->squares_touched[i].square] =
-		  undo_info->prev_states[i];
+		s = undo_info->prev_states[i];
+
+		BOARD_SQUARE(state, touched[i].level, touched[i].square) = s;
+
+		/* put the pieces back in their slots */
+		if (s != EMPTY) {
+			slot = undo_info->prev_slots[i];
+
+			PIECES(state, s & BLACK_FLAG)[slot] = touched[i];
+			state->piece_slot[touched[i].level][touched[i].square] =
+			  slot;
+		}
 	}
 
+	state->pieces_in_play[0] = undo_info->prev_pieces_in_play[0];
+	state->pieces_in_play[1] = undo_info->prev_pieces_in_play[1];
+
 	state->attack_board_bits = undo_info->prev_attack_board_bits;
 	state->attack_board_side = undo_info->prev_attack_board_side;
 	state->material_imbalance = undo_info->prev_material_imbalance;
+	state->positional_score = undo_info->prev_positional_score;
 	state->castling_rights = undo_info->prev_castling_rights;
+	state->hash = undo_info->prev_hash;
+	state->king_pos[0] = undo_info->prev_king_pos[0];
+	state->king_pos[1] = undo_info->prev_king_pos[1];
+	state->occupancy = undo_info->prev_occupancy;
+	memcpy(state->piece_bits, undo_info->prev_piece_bits,
+	  sizeof state->piece_bits);
 	state->cur_ply--;
 }
 
@@ -577,15 +1070,17 @@ attack_board_is_empty(const struct board_state *state,
 
 	get_attack_board_position(&pos, main_board, attack_board);
 
-	p = &state->board[pos.level][pos.square];
+	p = &BOARD_SQUARE(state, pos.level, pos.square);
 
 	for (i = 0; i < ATTACK_BOARD_SIZE; i++) {
 		for (j = 0; j < ATTACK_BOARD_SIZE; j++) {
-			if (*p++ != EMPTY)
+			if (*p != EMPTY)
 				return 0;
+
+			p += BOARD_SQUARE_STRIDE;
 		}
 
-		p += BCOLS - ATTACK_BOARD_SIZE;
+		p += (BCOLS - ATTACK_BOARD_SIZE)*BOARD_SQUARE_STRIDE;
 	}
 
 	return 1;
@@ -612,11 +1107,12 @@ attack_board_can_move(const struct board_state *state,
 	get_attack_board_position(&pos, main_board, attack_board);
 
 	piece_count = 0;
-	p = &state->board[pos.level][pos.square];
+	p = &BOARD_SQUARE(state, pos.level, pos.square);
 
 	for (i = 0; i < ATTACK_BOARD_SIZE; i++) {
 		for (j = 0; j < ATTACK_BOARD_SIZE; j++) {
-			s = *p++;
+			s = *p;
+			p += BOARD_SQUARE_STRIDE;
 
 			if (s != EMPTY) {
 				if ((s & BLACK_FLAG) != side)
@@ -629,7 +1125,7 @@ attack_board_can_move(const struct board_state *state,
 			}
 		}
 
-		p += BCOLS - ATTACK_BOARD_SIZE;
+		p += (BCOLS - ATTACK_BOARD_SIZE)*BOARD_SQUARE_STRIDE;
 	}
 
 	return 1;
@@ -714,7 +1210,19 @@ get_game_status(struct board_state *state)
 void
 init_board_state(struct board_state *state)
 {
+	int i, j;
+
 	memcpy(state, &initial_board_state, sizeof *state);
+
+	for (i = 0; i < BLEVELS; i++) {
+		for (j = 0; j < BAREA; j++)
+			BOARD_SQUARE(state, i, j) = initial_board[i][j];
+	}
+
+	state->hash = get_board_hash(state);
+	state->positional_score = get_board_positional_score(state);
+	init_occupancy(state);
+	init_piece_lists(state);
 }
 
 static void
@@ -725,6 +1233,14 @@ attack_board_as_string(const struct attack_board *ab, char *buf)
 	  5 - ab->main_board*2 + ATTACK_BOARD_IS_UP(ab->position));
 }
 
+/* with the side of the main board it's on, which inverting changes */
+static void
+attack_board_as_long_string(const struct attack_board *ab, char *buf)
+{
+	attack_board_as_string(ab, buf);
+	strcat(buf, ATTACK_BOARD_IS_ABOVE(ab->position) ? "a" : "b");
+}
+
 static void
 position_as_string(const struct board_state *state, const struct position *pos,
   char *buf)
@@ -773,14 +1289,27 @@ position_as_string(const struct board_state *state, const struct position *pos,
 	}
 }
 
+/* attack board squares get an a or b, as in attack_board_as_long_string */
+static void
+position_as_long_string(const struct board_state *state,
+  const struct position *pos, char *buf)
+{
+	struct attack_board ab = {0};
+
+	position_as_string(state, pos, buf);
+
+	if (get_attack_board_for_position(&ab, state, pos))
+		strcat(buf, ATTACK_BOARD_IS_ABOVE(ab.position) ? "a" : "b");
+}
+
 static void
 piece_move_as_string(const struct board_state *state,
   const struct piece_move *pm, char *buf)
 {
 	int piece_from, piece_to;
 
-	piece_from = state->board[pm->from.level][pm->from.square];
-	piece_to = state->board[pm->to.level][pm->to.square];
+	piece_from = BOARD_SQUARE(state, pm->from.level, pm->from.square);
+	piece_to = BOARD_SQUARE(state, pm->to.level, pm->to.square);
 
 	if ((piece_from & PIECE_MASK) != PAWN)
 		*buf++ = "RNBQK"[(piece_from & PIECE_MASK) - PAWN - 1];
@@ -831,6 +1360,136 @@ move_as_string(const struct board_state *state, const union move *move)
 	return buf;
 }
 
+/*
+ * move_as_long_string --
+ *	Like move_as_string, but with the squares (or attack board
+ *	positions) on both ends of the move, so it's never ambiguous:
+ *	"b2W-b4W", "QL1a-QL3a", "a9KL6a-b9KL6b" (a or b for attack
+ *	boards above or below the main board).
+ */
+char *
+move_as_long_string(const struct board_state *state, const union move *move)
+{
+	static char buf[80];
+	const struct piece_move *pm;
+
+	switch (move->type) {
+		case PIECE_MOVE:
+			pm = &move->piece_move;
+			position_as_long_string(state, &pm->from, buf);
+			strcat(buf, "-");
+			position_as_long_string(state, &pm->to,
+			  buf + strlen(buf));
+			break;
+
+		case ATTACK_BOARD_MOVE:
+			attack_board_as_long_string(
+			  &move->attack_board_move.from, buf);
+			strcat(buf, "-");
+			attack_board_as_long_string(
+			  &move->attack_board_move.to, buf + strlen(buf));
+			break;
+
+		default:
+			return move_as_string(state, move);
+	}
+
+	return buf;
+}
+
+/*
+ * parse_move --
+ *	Find the legal move for side that move_as_string or
+ *	move_as_long_string writes as str. Returns 0 if there's none, or
+ *	more than one.
+ */
+int
+parse_move(union move *move, struct board_state *state, int side,
+  const char *str)
+{
+	union move moves[MAX_MOVES];
+	int i, n, found;
+
+	n = get_legal_moves(moves, state, side);
+
+	for (i = 0; i < n; i++) {
+		if (!strcmp(move_as_long_string(state, &moves[i]), str)) {
+			*move = moves[i];
+			return 1;
+		}
+	}
+
+	found = 0;
+
+	for (i = 0; i < n; i++) {
+		if (!strcmp(move_as_string(state, &moves[i]), str)) {
+			*move = moves[i];
+			found++;
+		}
+	}
+
+	return found == 1;
+}
+
+/*
+ * pack_move --
+ *	Encode a move in 23 bits. Zero is never a valid packed move.
+ */
+unsigned
+pack_move(const union move *move)
+{
+	const struct piece_move *pm;
+	const struct attack_board_move *am;
+
+	switch (move->type) {
+		case PIECE_MOVE:
+			pm = &move->piece_move;
+
+			return PIECE_MOVE|
+			  (pm->from.level << 3)|(pm->from.square << 6)|
+			  (pm->to.level << 13)|(pm->to.square << 16);
+
+		case ATTACK_BOARD_MOVE:
+			am = &move->attack_board_move;
+
+			return ATTACK_BOARD_MOVE|
+			  (am->from.main_board << 3)|(am->from.position << 5)|
+			  (am->to.main_board << 8)|(am->to.position << 10);
+
+		default:
+			return move->type;
+	}
+}
+
+void
+unpack_move(union move *move, unsigned packed)
+{
+	move->type = packed & 7;
+
+	switch (move->type) {
+		case PIECE_MOVE:
+			move->piece_move.from.level = (packed >> 3) & 7;
+			move->piece_move.from.square = (packed >> 6) & 127;
+			move->piece_move.to.level = (packed >> 13) & 7;
+			move->piece_move.to.square = (packed >> 16) & 127;
+			break;
+
+		case ATTACK_BOARD_MOVE:
+			move->attack_board_move.from.main_board =
+			  (packed >> 3) & 3;
+			move->attack_board_move.from.position =
+			  (packed >> 5) & 7;
+			move->attack_board_move.to.main_board =
+			  (packed >> 8) & 3;
+			move->attack_board_move.to.position =
+			  (packed >> 10) & 7;
+			break;
+
+		default:
+			break;
+	}
+}
+
 #if 0
 void
 print_move(union move *move)
@@ -13,6 +13,8 @@
 #ifndef GAME_H_
 #define GAME_H_
 
+#include <string.h>
+
 enum player_type {
 	HUMAN_PLAYER,
 	COMPUTER_PLAYER
@@ -31,25 +33,54 @@ enum {
 	BCOLS = 6 + 2,		/* 2 extra columns for bounds checking */
 	BAREA = BROWS*BCOLS,
 
+	/* the board seen from above, without the extra rows and columns */
+	PROJECTED_ROWS = BROWS - 4,
+	PROJECTED_COLS = BCOLS - 2,
+	PROJECTED_AREA = PROJECTED_ROWS*PROJECTED_COLS,
+
 	NUM_MAIN_BOARDS = 3,
 	NUM_ATTACK_BOARDS_PER_SIDE = 2,
 	NUM_ATTACK_BOARDS = 2*NUM_ATTACK_BOARDS_PER_SIDE,
 
 	MAIN_BOARD_SIZE = 4,
 	ATTACK_BOARD_SIZE = 2,
+
+	MAX_PIECES_PER_SIDE = 16,
 };
 
-struct board_state {
-	unsigned char board[BLEVELS][BAREA];
-	unsigned attack_board_bits;		/* bit map for presence of
-						 * attack boards  */
-	unsigned attack_board_side;		/* bit map for color of
-						 * attack boards  */
-	int material_imbalance;			/* positive value is good for
-						 * white */
-	unsigned castling_rights;		/* bitmap for castling rights */
-	int cur_ply;
+struct position {
+	int level;
+	int square;
+};
+
+#define SAME_POS(p, q) ((p)->level == (q)->level && (p)->square == (q)->square)
+
+/*
+ * The board is kept square major: the BLEVELS levels of each square are
+ * stored together in a column of BOARD_COLUMN_SIZE bytes (the last one
+ * unused and always EMPTY), so that what's on a square at any level can
+ * be read with a single 64-bit load. Building with LEVEL_MAJOR_BOARD
+ * defined stores it level by level instead, one BAREA array per level.
+ * Either way, squares are accessed through BOARD_SQUARE.
+ */
+#ifdef LEVEL_MAJOR_BOARD
+enum {
+	BOARD_LEVEL_STRIDE = BAREA,
+	BOARD_SQUARE_STRIDE = 1,
+	BOARD_SIZE = BLEVELS*BAREA,
+};
+#else
+enum {
+	BOARD_COLUMN_SIZE = 8,
+	BOARD_LEVEL_STRIDE = 1,
+	BOARD_SQUARE_STRIDE = BOARD_COLUMN_SIZE,
+	BOARD_SIZE = BAREA*BOARD_COLUMN_SIZE,
 };
+#endif
+
+#define BOARD_SQUARE(state, level, square) \
+	((state)->board[(level)*BOARD_LEVEL_STRIDE + \
+	  (square)*BOARD_SQUARE_STRIDE])
 
 enum square_state {
 	BLACK_FLAG = 8,
@@ -87,6 +118,38 @@ enum square_state {
 	BLACK_KING = BLACK_FLAG|KING,
 };
 
+struct board_state {
+	unsigned char board[BOARD_SIZE];	/* see BOARD_SQUARE */
+	unsigned attack_board_bits;		/* bit map for presence of
+						 * attack boards  */
+	unsigned attack_board_side;		/* bit map for color of
+						 * attack boards  */
+	int material_imbalance;			/* positive value is good for
+						 * white */
+	int positional_score;			/* same, for piece placement */
+	unsigned castling_rights;		/* bitmap for castling rights */
+	int cur_ply;
+	unsigned long long hash;		/* zobrist key (side to move
+						 * not included) */
+	struct position king_pos[2];		/* white's king, then
+						 * black's */
+	unsigned long long occupancy;		/* a SQUARE_BIT for each
+						 * square with a piece on
+						 * some level */
+	unsigned long long piece_bits[2][NUM_PIECES]; /* the same, for each
+						 * piece of each side */
+
+	/*
+	 * piece lists, white's then black's: a piece keeps its slot until
+	 * it's captured, and pieces_in_play has a bit set for each slot in
+	 * use
+	 */
+	struct position pieces[2][MAX_PIECES_PER_SIDE];
+	unsigned pieces_in_play[2];
+	unsigned char piece_slot[BLEVELS][BAREA]; /* of the piece on each
+						 * square */
+};
+
 /* attack board position bits */
 enum {
 	AB_UP_FLAG = 1,
@@ -166,13 +229,6 @@ enum move_type {
 	BLACK_QUEENSIDE_CASTLING,
 };
 
-struct position {
-	int level;
-	int square;
-};
-
-#define SAME_POS(p, q) ((p)->level == (q)->level && (p)->square == (q)->square)
-
 struct attack_board {
 	int main_board;		/* main board the attack board is attached to */
 	int position;		/* position of the attack board with respect
@@ -205,14 +261,131 @@ struct undo_move_info {
 	int num_squares_touched;
 	struct position squares_touched[MAX_SQUARES_TOUCHED_PER_MOVE]; 
 	unsigned char prev_states[MAX_SQUARES_TOUCHED_PER_MOVE];
+	unsigned char prev_slots[MAX_SQUARES_TOUCHED_PER_MOVE];
 	unsigned prev_attack_board_bits;
 	unsigned prev_attack_board_side;
 	unsigned prev_castling_rights;
 	int prev_material_imbalance;
+	int prev_positional_score;
+	unsigned long long prev_hash;
+	struct position prev_king_pos[2];
+	unsigned prev_pieces_in_play[2];
+	unsigned long long prev_occupancy;
+	unsigned long long prev_piece_bits[2][NUM_PIECES];
 };
 
 extern const int piece_values[NUM_PIECES];
 
+extern unsigned long long black_to_move_hash_key;
+
+/* position of the king of the given side */
+#define KING_POS(state, side) ((state)->king_pos[(side) == BLACK_FLAG])
+
+/* piece list of the given side */
+#define PIECES(state, side) ((state)->pieces[(side) == BLACK_FLAG])
+#define PIECES_IN_PLAY(state, side) \
+  ((state)->pieces_in_play[(side) == BLACK_FLAG])
+
+/*
+ * bit of a square in the occupancy: squares are numbered row by row on the
+ * board seen from above, so rays that go forward in the board go towards
+ * the higher bits
+ */
+#define SQUARE_BIT(square) \
+  (1ULL << (((square)/BCOLS - 2)*PROJECTED_COLS + (square)%BCOLS - 1))
+
+/* squares with the given piece, moved or not, of the given side */
+#define PIECE_BITS(state, side, piece) \
+  ((state)->piece_bits[(side) == BLACK_FLAG][(piece) - PAWN])
+
+#ifndef LEVEL_MAJOR_BOARD
+/*
+ * With the board stored square major, the levels of a square are the
+ * bytes of a 64-bit column, so questions about all of them take a load
+ * and a few bit operations.
+ */
+#define COLUMN_BYTES(b) (0x0101010101010101ULL*(b))
+
+/* nonzero if some byte of c is zero */
+#define HAS_ZERO_BYTE(c) \
+  (((c) - COLUMN_BYTES(1)) & ~(c) & COLUMN_BYTES(0x80))
+
+/*
+ * get_board_column --
+ *	The levels of square, one per byte, in a single load.
+ */
+static inline unsigned long long
+get_board_column(const struct board_state *state, int square)
+{
+	unsigned long long c;
+
+	memcpy(&c, &BOARD_SQUARE(state, 0, square), sizeof c);
+
+	return c;
+}
+#endif
+
+/*
+ * square_is_empty --
+ *	True if no level of square holds a piece.
+ */
+static inline int
+square_is_empty(const struct board_state *state, int square)
+{
+#ifdef LEVEL_MAJOR_BOARD
+	int l;
+
+	for (l = 0; l < BLEVELS; l++) {
+		if (BOARD_SQUARE(state, l, square) != EMPTY)
+			return 0;
+	}
+
+	return 1;
+#else
+	return get_board_column(state, square) == 0;
+#endif
+}
+
+/*
+ * has_piece_at --
+ *	True if piece (with its side), moved or not, is on some level of
+ *	square.
+ */
+static inline int
+has_piece_at(const struct board_state *state, int square, int piece)
+{
+#ifdef LEVEL_MAJOR_BOARD
+	int l, s;
+
+	for (l = 0; l < BLEVELS; l++) {
+		s = BOARD_SQUARE(state, l, square);
+
+		if (s == INVALID)
+			break;
+
+		if ((s & ~MOVED_FLAG) == piece)
+			return 1;
+	}
+
+	return 0;
+#else
+	/* the unused byte is EMPTY, and a square off the board is INVALID
+	 * at all levels, so neither can match */
+	unsigned long long c;
+
+	c = get_board_column(state, square) & COLUMN_BYTES(~MOVED_FLAG & 0xff);
+
+	return HAS_ZERO_BYTE(c ^ COLUMN_BYTES(piece)) != 0;
+#endif
+}
+
+/* zobrist key for position with given side to move */
+#define HASH_KEY(state, side) \
+  ((state)->hash ^ ((side) == BLACK_FLAG ? black_to_move_hash_key : 0ULL))
+
+void
+init_hash_keys(void);
+
 void
 init_board_state(struct board_state *state);
 
@@ -252,4 +425,17 @@ get_closest_main_board_square_for_attack_board(struct position *pos,
 char *
 move_as_string(const struct board_state *state, const union move *move);
 
+char *
+move_as_long_string(const struct board_state *state, const union move *move);
+
+int
+parse_move(union move *move, struct board_state *state, int side,
+  const char *str);
+
+unsigned
+pack_move(const union move *move);
+
+void
+unpack_move(union move *move, unsigned packed);
+
 #endif /* GAME_H_ */
@@ -0,0 +1,485 @@
+/* main-engine.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/*
+ * vulcan-engine: the search, with no graphics, driven by text commands on
+ * stdin, one per line. Replies go to stdout.
+ *
+ *	position [startpos] [moves move...]
+ *		start from the initial position and play the moves
+ *	moves move...
+ *		play the moves on the current position
+ *	go [depth n] [movetime msecs] [nodes n] [multipv n] [infinite]
+ *		search the current position; prints an info line after every
+ *		iteration and a bestmove line when done. With multipv, the
+ *		best n moves are ranked, and printed before bestmove with
+ *		their scores and principal variations
+ *	stop
+ *		end the search in progress now
+ *	isready
+ *		replies readyok, even while searching
+ *	legal
+ *		lists the legal moves
+ *	quit
+ *
+ * Moves are read as written in the move history or as move_as_long_string
+ * writes them ("b2W-b4W"), and always written the long way, which is never
+ * ambiguous. Errors are reported on lines starting with "error".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include "panic.h"
+#include "move.h"
+#include "game.h"
+#include "engine.h"
+#include "book.h"
+
+enum {
+	DEFAULT_NUM_THREADS = 1,
+	MAX_LINE = 8192,
+};
+
+static const struct {
+	const char *name;
+	enum search_feature feature;
+} feature_names[] = {
+	{ "null", NULL_MOVE_PRUNING },
+	{ "lmr", LATE_MOVE_REDUCTIONS },
+	{ "aspiration", ASPIRATION_WINDOWS },
+	{ "delta", DELTA_PRUNING },
+};
+
+static struct board_state cur_state;
+static int cur_side;
+
+static int infinite;			/* searching with no limits */
+
+/* input not yet parsed into lines */
+static char input[MAX_LINE];
+static int input_len;
+static int input_eof;
+
+/*
+ * read_input --
+ *	Read whatever there is on stdin into input, waiting for it if wait
+ *	is set.
+ */
+static void
+read_input(int wait)
+{
+	fd_set fds;
+	struct timeval tv;
+	int n;
+
+	if (input_eof || input_len == sizeof input)
+		return;
+
+	if (!wait) {
+		FD_ZERO(&fds);
+		FD_SET(0, &fds);
+		tv.tv_sec = tv.tv_usec = 0;
+
+		if (select(1, &fds, NULL, NULL, &tv) <= 0)
+			return;
+	}
+
+	do {
+		n = read(0, input + input_len, sizeof input - input_len);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0)
+		input_eof = 1;
+	else
+		input_len += n;
+}
+
+/*
+ * get_line --
+ *	Take the next complete line out of input into line, or just copy it
+ *	if peek is set. Returns 0 if there's none yet. A line too long for
+ *	input is cut in two.
+ */
+static int
+get_line(char *line, int peek)
+{
+	char *end;
+	int len;
+
+	if ((end = memchr(input, '\n', input_len)) != NULL)
+		len = end - input + 1;
+	else if (input_len == sizeof input || (input_eof && input_len > 0))
+		len = input_len;
+	else
+		return 0;
+
+	memcpy(line, input, len);
+	line[len] = '\0';
+
+	if (!peek) {
+		input_len -= len;
+		memmove(input, input + len, input_len);
+	}
+
+	if (len > 0 && line[len - 1] == '\n')
+		line[--len] = '\0';
+
+	if (len > 0 && line[len - 1] == '\r')
+		line[--len] = '\0';
+
+	return 1;
+}
+
+/*
+ * poll_input --
+ *	Called by the search every few thousand nodes. Handles the commands
+ *	that make sense during a search; the first other command, and
+ *	everything after it, waits for the search to end. On quit the
+ *	search stops right away, as does an infinite one at the end of the
+ *	input.
+ */
+static void
+poll_input(void)
+{
+	char line[MAX_LINE + 1];
+	char *cmd;
+
+	read_input(0);
+
+	while (get_line(line, 1)) {
+		if ((cmd = strtok(line, " \t")) != NULL) {
+			if (!strcmp(cmd, "isready")) {
+				printf("readyok\n");
+			} else if (!strcmp(cmd, "stop")) {
+				get_line(line, 0);
+				stop_search();
+				return;
+			} else {
+				/* quit, or has to wait */
+				if (!strcmp(cmd, "quit"))
+					stop_search();
+				return;
+			}
+		}
+
+		get_line(line, 0);
+	}
+
+	/* nobody left to stop it */
+	if (input_eof && input_len == 0 && infinite)
+		stop_search();
+}
+
+static void
+report_iteration(const struct search_stats *stats, const union move *move)
+{
+	printf("info depth %d score %d nodes %lu nps %lu time %ld pv %s\n",
+	  stats->depth, stats->score, stats->nodes, stats->nps, stats->msecs,
+	  move_as_long_string(&cur_state, move));
+}
+
+/*
+ * play_moves --
+ *	Play the moves in the rest of the strtok'd line on the current
+ *	position. Stops at the first one that isn't legal.
+ */
+static void
+play_moves(void)
+{
+	struct undo_move_info undo_info;
+	union move move;
+	char *str;
+
+	while ((str = strtok(NULL, " \t")) != NULL) {
+		if (!parse_move(&move, &cur_state, cur_side, str)) {
+			printf("error invalid or ambiguous move: %s\n", str);
+			return;
+		}
+
+		do_move(&cur_state, &move, &undo_info);
+		cur_side ^= BLACK_FLAG;
+	}
+}
+
+static void
+cmd_position(void)
+{
+	char *arg;
+
+	init_board_state(&cur_state);
+	cur_side = 0;
+
+	if ((arg = strtok(NULL, " \t")) != NULL && !strcmp(arg, "startpos"))
+		arg = strtok(NULL, " \t");
+
+	if (arg == NULL)
+		return;
+
+	if (strcmp(arg, "moves")) {
+		printf("error expected moves: %s\n", arg);
+		return;
+	}
+
+	play_moves();
+}
+
+/*
+ * print_lines --
+ *	The lines of a multi-PV search, best first.
+ */
+static void
+print_lines(const struct search_line *lines, int num_lines)
+{
+	struct board_state state;
+	struct undo_move_info undo_info;
+	int i, j;
+
+	for (i = 0; i < num_lines; i++) {
+		printf("info multipv %d score %d pv", i + 1, lines[i].score);
+
+		state = cur_state;
+
+		for (j = 0; j < lines[i].pv_length; j++) {
+			printf(" %s", move_as_long_string(&state,
+			  &lines[i].pv[j]));
+			do_move(&state, &lines[i].pv[j], &undo_info);
+		}
+
+		printf("\n");
+	}
+}
+
+static void
+cmd_go(void)
+{
+	union move moves[MAX_MOVES], move;
+	struct search_line lines[MAX_SEARCH_LINES];
+	unsigned long max_nodes;
+	long max_msecs;
+	int max_depth, num_lines;
+	char *arg, *val, *p;
+
+	max_depth = MAX_SEARCH_DEPTH;
+	max_msecs = 0;
+	max_nodes = 0;
+	num_lines = 1;
+
+	while ((arg = strtok(NULL, " \t")) != NULL) {
+		if (!strcmp(arg, "infinite"))
+			continue;
+
+		if ((val = strtok(NULL, " \t")) == NULL) {
+			printf("error missing value: %s\n", arg);
+			return;
+		}
+
+		if (!strcmp(arg, "depth")) {
+			max_depth = strtol(val, &p, 10);
+			if (*p != '\0' || max_depth < 0 ||
+			  max_depth > MAX_SEARCH_DEPTH) {
+				printf("error invalid depth: %s\n", val);
+				return;
+			}
+		} else if (!strcmp(arg, "movetime")) {
+			max_msecs = strtol(val, &p, 10);
+			if (*p != '\0' || max_msecs < 1) {
+				printf("error invalid movetime: %s\n", val);
+				return;
+			}
+		} else if (!strcmp(arg, "multipv")) {
+			num_lines = strtol(val, &p, 10);
+			if (*p != '\0' || num_lines < 1 ||
+			  num_lines > MAX_SEARCH_LINES) {
+				printf("error invalid multipv: %s\n", val);
+				return;
+			}
+		} else if (!strcmp(arg, "nodes")) {
+			max_nodes = strtoul(val, &p, 10);
+			if (*p != '\0' || max_nodes < 1) {
+				printf("error invalid nodes: %s\n", val);
+				return;
+			}
+		} else {
+			printf("error unknown limit: %s\n", arg);
+			return;
+		}
+	}
+
+	if (get_legal_moves(moves, &cur_state, cur_side) == 0) {
+		printf("bestmove none\n");
+		return;
+	}
+
+	set_search_node_limit(max_nodes);
+
+	infinite = max_depth == MAX_SEARCH_DEPTH && max_msecs == 0 &&
+	  max_nodes == 0;
+
+	if (num_lines > 1) {
+		num_lines = get_best_lines(lines, num_lines, &cur_state,
+		  cur_side, max_depth, max_msecs);
+		print_lines(lines, num_lines);
+		move = lines[0].pv[0];
+	} else {
+		get_best_move(&move, &cur_state, cur_side, max_depth,
+		  max_msecs);
+	}
+
+	printf("bestmove %s\n", move_as_long_string(&cur_state, &move));
+}
+
+static void
+cmd_legal(void)
+{
+	union move moves[MAX_MOVES];
+	int i, n;
+
+	n = get_legal_moves(moves, &cur_state, cur_side);
+
+	printf("legal");
+
+	for (i = 0; i < n; i++)
+		printf(" %s", move_as_long_string(&cur_state, &moves[i]));
+
+	printf("\n");
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: vulcan-engine [options]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Searches positions given by text commands on "
+	  "stdin; see the comment at the\ntop of main-engine.c.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -t threads  number of search threads [%d]\n",
+	  DEFAULT_NUM_THREADS);
+	fprintf(stderr, "  -y          split the search tree among threads "
+	  "(young brothers wait)\n");
+	fprintf(stderr, "  -b book     opening book [none]\n");
+	fprintf(stderr, "  -x feature  turn off a part of the search: null, "
+	  "lmr, aspiration\n              or delta (may be repeated)\n");
+	fprintf(stderr, "  -h          this help\n");
+
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char line[MAX_LINE + 1];
+	enum parallel_search parallel_search;
+	const char *book_path;
+	unsigned features;
+	int c, i, num_threads;
+	char *cmd, *p;
+
+	num_threads = DEFAULT_NUM_THREADS;
+	parallel_search = LAZY_SMP;
+	book_path = NULL;
+	features = ALL_SEARCH_FEATURES;
+
+	while ((c = getopt(argc, argv, "t:yb:x:h")) != EOF) {
+		switch (c) {
+			case 't':
+				num_threads = strtol(optarg, &p, 10);
+				if (p == optarg || num_threads < 1)
+					usage();
+				break;
+
+			case 'y':
+				parallel_search = SPLIT_POINTS;
+				break;
+
+			case 'b':
+				book_path = optarg;
+				break;
+
+			case 'x':
+				for (i = 0; i < sizeof feature_names/
+				  sizeof *feature_names; i++) {
+					if (!strcmp(feature_names[i].name,
+					  optarg))
+						break;
+				}
+
+				if (i == sizeof feature_names/
+				  sizeof *feature_names)
+					usage();
+
+				features &= ~feature_names[i].feature;
+				break;
+
+			case 'h':
+			default:
+				usage();
+		}
+	}
+
+	if (optind != argc)
+		usage();
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	init_hash_keys();
+	init_move_tables();
+	init_engine(num_threads, parallel_search);
+	set_search_features(features);
+
+	if (book_path != NULL && !book_open(book_path))
+		panic("couldn't open book %s", book_path);
+
+	set_search_poll(poll_input);
+	set_search_report(report_iteration);
+
+	init_board_state(&cur_state);
+	cur_side = 0;
+
+	for (;;) {
+		if (!get_line(line, 0)) {
+			if (input_eof)
+				break;
+
+			read_input(1);
+			continue;
+		}
+
+		if ((cmd = strtok(line, " \t")) == NULL)
+			continue;
+
+		if (!strcmp(cmd, "position"))
+			cmd_position();
+		else if (!strcmp(cmd, "moves"))
+			play_moves();
+		else if (!strcmp(cmd, "go"))
+			cmd_go();
+		else if (!strcmp(cmd, "stop"))
+			;	/* nothing to stop */
+		else if (!strcmp(cmd, "isready"))
+			printf("readyok\n");
+		else if (!strcmp(cmd, "legal"))
+			cmd_legal();
+		else if (!strcmp(cmd, "quit"))
+			break;
+		else
+			printf("error unknown command: %s\n", cmd);
+	}
+
+	return 0;
+}
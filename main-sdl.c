@@ -41,6 +41,7 @@
 #include "move.h"
 #include "game.h"
 #include "engine.h"
+#include "mate.h"
 #include "font.h"
 #include "ui.h"
 
@@ -50,7 +51,8 @@
 enum {
 	WIDTH = 640,			/* window start width */
 	HEIGHT = 512,			/* window start height */
-	DEFAULT_MAX_DEPTH = 4,		/* default AI search depth */
+	DEFAULT_MAX_SECS = 10,		/* default AI time per move */
+	DEFAULT_NUM_THREADS = 1,	/* default AI search threads */
 	CHILD_WAIT_TIMEOUT = 1,		/* in seconds */
 	UTIMER = 33
 };
@@ -59,14 +61,22 @@ static struct worker_request {
 	struct board_state state;
 	int side;
 	int max_depth;
+	long max_msecs;
+	int ponder;			/* think on the opponent's time */
+	int mate_moves;			/* look for mates first */
 } worker_request;
 
 static struct {
 	SDL_Thread *thread;
 	union move next_move;
+	struct search_stats stats;	/* of the search for next_move */
 	int request_ready;
 	SDL_mutex *request_mutex;
 	SDL_cond *request_cond;
+	int pondering;			/* protected by request_mutex */
+	unsigned long long ponder_key;	/* position we're pondering on */
+	int searching;			/* for a reply; protected too */
+	int cancelled_replies;		/* replies to throw away */
 } worker_thread;
 
 static int sdl_flags;
@@ -91,6 +101,8 @@ worker_loop(void *dummy)
 	while (!done) {
 		struct worker_request req;
 		SDL_Event event;
+		union move move;
+		struct search_stats stats;
 
 		SDL_mutexP(worker_thread.request_mutex);
 
@@ -102,17 +114,65 @@ worker_loop(void *dummy)
 
 		worker_thread.request_ready = 0;
 
-		if (!done)
+		if (!done) {
 			req = worker_request;
+			worker_thread.searching = 1;
+		}
 
 		SDL_mutexV(worker_thread.request_mutex);
 
 		if (!done) {
-			get_best_move(&worker_thread.next_move, &req.state,
-			  req.side, req.max_depth);
+			if (req.mate_moves > 0 && find_mate(&move,
+			  &req.state, req.side, req.mate_moves,
+			  MATE_SEARCH_NODES, MATE_SEARCH_BYTES) == MATE_FOUND) {
+				memset(&stats, 0, sizeof stats);
+			} else {
+				get_best_move(&move, &req.state, req.side,
+				  req.max_depth, req.max_msecs);
+				get_search_stats(&stats);
+			}
+
+			/*
+			 * reply, then search the position after the reply
+			 * we expect until send_worker_request tells us if
+			 * the opponent played it (and we can reply again)
+			 */
+			for (;;) {
+				SDL_mutexP(worker_thread.request_mutex);
+
+				worker_thread.next_move = move;
+				worker_thread.stats = stats;
+
+				/* a late stop is for the search just done */
+				worker_thread.searching = 0;
+				clear_stop_search();
+
+				worker_thread.pondering = req.ponder &&
+				  worker_thread.request_ready != -1 &&
+				  get_ponder_position(&req.state, req.side,
+				    &move);
+
+				if (worker_thread.pondering)
+					worker_thread.ponder_key =
+					  HASH_KEY(&req.state, req.side);
+
+				SDL_mutexV(worker_thread.request_mutex);
+
+				event.type = SDL_USEREVENT;
+				SDL_PushEvent(&event);
 
-			event.type = SDL_USEREVENT;
-			SDL_PushEvent(&event);
+				if (!worker_thread.pondering ||
+				  !ponder(&move, &req.state, req.side,
+				    req.max_depth))
+					break;
+
+				get_search_stats(&stats);
+			}
+
+			SDL_mutexP(worker_thread.request_mutex);
+			worker_thread.pondering = 0;
+			clear_stop_search();
+			SDL_mutexV(worker_thread.request_mutex);
 		}
 	}
 
@@ -136,6 +196,9 @@ kill_worker(void)
 
 	SDL_mutexP(worker_thread.request_mutex);
 
+	if (worker_thread.pondering || worker_thread.searching)
+		stop_search();
+
 	worker_thread.request_ready = -1;
 
 	SDL_CondSignal(worker_thread.request_cond);
@@ -149,9 +212,28 @@ send_worker_request(void)
 {
 	SDL_mutexP(worker_thread.request_mutex);
 
+	if (worker_thread.pondering) {
+		if (HASH_KEY(&ui.board_state, ui.cur_side) ==
+		  worker_thread.ponder_key) {
+			/* ponder hit, the reply comes from that search */
+			ponder_hit(ui_get_think_msecs());
+			worker_thread.searching = 1;
+
+			SDL_mutexV(worker_thread.request_mutex);
+
+			return 0;
+		}
+
+		stop_search();
+	}
+
 	worker_request.state = ui.board_state;
 	worker_request.side = ui.cur_side;
 	worker_request.max_depth = ui.max_depth;
+	worker_request.max_msecs = ui_get_think_msecs();
+	worker_request.ponder = ui.ponder &&
+	  ui.players[ui.cur_side != BLACK_FLAG] == HUMAN_PLAYER;
+	worker_request.mate_moves = ui.mate_moves;
 
 	worker_thread.request_ready = 1;
 
@@ -161,6 +243,81 @@ send_worker_request(void)
 	return 0;
 }
 
+/*
+ * on_cancelled_reply --
+ *	Throw away a reply to a cancelled request, and stop the ponder
+ *	search that may have followed it.
+ */
+static void
+on_cancelled_reply(void)
+{
+	SDL_mutexP(worker_thread.request_mutex);
+
+	worker_thread.cancelled_replies--;
+
+	if (worker_thread.pondering) {
+		stop_search();
+		worker_thread.pondering = 0;
+	}
+
+	SDL_mutexV(worker_thread.request_mutex);
+}
+
+/*
+ * worker_move_now --
+ *	Have the worker answer right away with the best move it has found.
+ */
+void
+worker_move_now(void)
+{
+	SDL_mutexP(worker_thread.request_mutex);
+
+	if (worker_thread.searching)
+		stop_search();
+
+	SDL_mutexV(worker_thread.request_mutex);
+}
+
+/*
+ * cancel_worker_request --
+ *	Stop the search for the last request, whose reply is no longer
+ *	wanted (the game it was for is over).
+ */
+void
+cancel_worker_request(void)
+{
+	SDL_mutexP(worker_thread.request_mutex);
+
+	if (worker_thread.request_ready == 1) {
+		/* not taken yet, there'll be no reply */
+		worker_thread.request_ready = 0;
+	} else {
+		if (worker_thread.searching)
+			stop_search();
+
+		worker_thread.cancelled_replies++;
+	}
+
+	SDL_mutexV(worker_thread.request_mutex);
+}
+
+/*
+ * stop_pondering --
+ *	Stop the ponder search, if any; the position it was for is gone.
+ */
+void
+stop_pondering(void)
+{
+	SDL_mutexP(worker_thread.request_mutex);
+
+	if (worker_thread.pondering) {
+		stop_search();
+		worker_thread.pondering = 0;
+	}
+
+	SDL_mutexV(worker_thread.request_mutex);
+}
+
 void
 event_loop(void)
 {
@@ -200,6 +357,9 @@ event_loop(void)
 				case SDL_KEYDOWN:
 					if (event.key.keysym.sym == SDLK_ESCAPE)
 						ui_on_escape_press();
+					else if (event.key.keysym.sym ==
+					  SDLK_SPACE)
+						ui_on_move_now();
 					break;
 
 				case SDL_KEYUP:
@@ -215,6 +375,12 @@ event_loop(void)
 
 				case SDL_USEREVENT:
 					/* answer from worker */
+					if (worker_thread.cancelled_replies > 0) {
+						on_cancelled_reply();
+						break;
+					}
+
+					ui.search_stats = worker_thread.stats;
 					ui_on_worker_reply(
 					  &worker_thread.next_move);
 					break;
@@ -268,7 +434,16 @@ usage(void)
 	fprintf(stderr, "  -c   computer vs. computer\n");
 	fprintf(stderr, "  -u   human vs. human\n");
 	fprintf(stderr, "  -b   play black\n");
-	fprintf(stderr, "  -d   set maximum AI search depth\n");
+	fprintf(stderr, "  -d   limit the AI search depth (by default "
+	  "only time limits it)\n");
+	fprintf(stderr, "  -s   set average AI thinking time per move, "
+	  "in seconds\n");
+	fprintf(stderr, "  -t   set number of AI search threads\n");
+	fprintf(stderr, "  -p   think on the opponent's time\n");
+	fprintf(stderr, "  -m   look for forced mates in up to this many "
+	  "moves before searching\n");
+	fprintf(stderr, "  -y   split the search tree among threads (young "
+	  "brothers wait),\n       instead of sharing only the hash table\n");
 
 	exit(1);
 }
@@ -279,13 +454,23 @@ main(int argc, char *argv[])
 	int c;
 	enum player_type white_player, black_player;
 	int max_depth;
+	long max_secs;
+	int num_threads;
+	enum parallel_search parallel_search;
+	int ponder;
+	int mate_moves;
 	char *p;
 
 	white_player = HUMAN_PLAYER;
 	black_player = COMPUTER_PLAYER;
-	max_depth = DEFAULT_MAX_DEPTH;
-
-	while ((c = getopt(argc, argv, "cubd:h")) != EOF) {
+	max_depth = MAX_SEARCH_DEPTH;
+	max_secs = DEFAULT_MAX_SECS;
+	num_threads = DEFAULT_NUM_THREADS;
+	parallel_search = LAZY_SMP;
+	ponder = 0;
+	mate_moves = 0;
+
+	while ((c = getopt(argc, argv, "cubd:s:t:pm:yh")) != EOF) {
 		switch (c) {
 			case 'c':
 				white_player = black_player = COMPUTER_PLAYER;
@@ -302,17 +487,47 @@ main(int argc, char *argv[])
 
 			case 'd':
 				max_depth = strtol(optarg, &p, 10);
-				if (p == optarg || max_depth < 1)
+				if (p == optarg || max_depth < 1 ||
+				  max_depth > MAX_SEARCH_DEPTH)
 					usage();
 				break;
 
+			case 's':
+				max_secs = strtol(optarg, &p, 10);
+				if (p == optarg || max_secs < 1)
+					usage();
+				break;
+
+			case 't':
+				num_threads = strtol(optarg, &p, 10);
+				if (p == optarg || num_threads < 1)
+					usage();
+				break;
+
+			case 'p':
+				ponder = 1;
+				break;
+
+			case 'm':
+				mate_moves = strtol(optarg, &p, 10);
+				if (p == optarg || mate_moves < 1)
+					usage();
+				break;
+
+			case 'y':
+				parallel_search = SPLIT_POINTS;
+				break;
+
 			case 'h':
 			default:
 				usage();
 		}
 	}
 
-	ui_initialize(white_player, black_player, max_depth, WIDTH, HEIGHT);
+	ui_initialize(white_player, black_player, max_depth, max_secs*1000,
+	  num_threads, parallel_search, WIDTH, HEIGHT);
+	ui.ponder = ponder;
+	ui.mate_moves = mate_moves;
 
 	initialize_sdl();
 	gl_initialize();
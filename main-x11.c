@@ -42,6 +42,7 @@
 #include "move.h"
 #include "game.h"
 #include "engine.h"
+#include "mate.h"
 #include "font.h"
 #include "ui.h"
 
@@ -51,7 +52,8 @@
 enum {
 	WIDTH = 640,			/* window start width */
 	HEIGHT = 512,			/* window start height */
-	DEFAULT_MAX_DEPTH = 4,		/* default AI search depth */
+	DEFAULT_MAX_SECS = 10,		/* default AI time per move */
+	DEFAULT_NUM_THREADS = 1,	/* default AI search threads */
 	CHILD_WAIT_TIMEOUT = 1,		/* in seconds */
 	UTIMER = 33333
 };
@@ -61,12 +63,32 @@ static Atom close_atom;
 struct worker_thread {
 	pid_t pid;
 	int write_to_fd, read_from_fd; /* pipes */
+	int pondering;
+	unsigned long long ponder_key;	/* position it's pondering on */
+	int cancelled_replies;		/* replies to throw away */
+};
+
+enum worker_request_type {
+	SEARCH_REQUEST,
+	PONDER_HIT_REQUEST,		/* only max_msecs is used */
+	STOP_PONDERING_REQUEST,		/* no fields used */
+	MOVE_NOW_REQUEST,		/* no fields used */
 };
 
 struct worker_request {
+	enum worker_request_type type;
 	struct board_state state;
 	int side;
 	int max_depth;
+	long max_msecs;
+	int ponder;			/* think on the opponent's time */
+	int mate_moves;			/* look for mates first */
+};
+
+struct worker_reply {
+	union move move;
+	unsigned long long ponder_key;	/* 0 if not pondering */
+	struct search_stats stats;
 };
 
 static Display *the_display;
@@ -250,21 +272,131 @@ write_exact(int fd, void *vbuf, size_t length)
 	return length;
 }
 
+/* set while pondering, until the ponder hit or stop request is read */
+static int worker_awaits_ponder_request;
+
+/* a search request read during a search, which it ends */
+static struct worker_request pending_request;
+static int have_pending_request;
+
+/*
+ * worker_poll --
+ *	Called by the search. Reads the next request, if it has arrived:
+ *	the one that ends pondering, a move now (which a ponder search
+ *	ignores, since it's for the search before it), or a new search.
+ */
+static void
+worker_poll(void)
+{
+	struct worker_request req;
+	fd_set fds;
+	struct timeval tv;
+
+	if (have_pending_request)
+		return;
+
+	FD_ZERO(&fds);
+	FD_SET(STDIN_FILENO, &fds);
+
+	tv.tv_sec = tv.tv_usec = 0;
+
+	if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) <= 0)
+		return;
+
+	if (read_exact(STDIN_FILENO, &req, sizeof req) != sizeof req)
+		panic("worker got eof while reading data");
+
+	switch (req.type) {
+		case PONDER_HIT_REQUEST:
+			if (worker_awaits_ponder_request) {
+				worker_awaits_ponder_request = 0;
+				ponder_hit(req.max_msecs);
+			}
+			break;
+
+		case STOP_PONDERING_REQUEST:
+			if (worker_awaits_ponder_request) {
+				worker_awaits_ponder_request = 0;
+				stop_search();
+			}
+			break;
+
+		case MOVE_NOW_REQUEST:
+			if (!worker_awaits_ponder_request)
+				stop_search();
+			break;
+
+		case SEARCH_REQUEST:
+			pending_request = req;
+			have_pending_request = 1;
+			stop_search();
+			break;
+	}
+}
+
 static void
 worker_loop(void)
 {
 	struct worker_request req;
+	struct worker_reply reply;
 	union move next_move;
 
+	set_search_poll(worker_poll);
+
 	for (;;) {
 		/* read request */
-		if (read_exact(STDIN_FILENO, &req, sizeof req) != sizeof req)
+		if (have_pending_request) {
+			req = pending_request;
+			have_pending_request = 0;
+		} else if (read_exact(STDIN_FILENO, &req, sizeof req) !=
+		  sizeof req) {
 			panic("worker got eof while reading data");
+		}
 
-		get_best_move(&next_move, &req.state, req.side, req.max_depth);
+		/* a stop for a search that has already ended */
+		if (req.type != SEARCH_REQUEST)
+			continue;
 
-		/* write answer */
-		write(STDOUT_FILENO, &next_move, sizeof next_move);
+		if (req.mate_moves > 0 && find_mate(&next_move, &req.state,
+		  req.side, req.mate_moves, MATE_SEARCH_NODES,
+		  MATE_SEARCH_BYTES) == MATE_FOUND) {
+			memset(&reply.stats, 0, sizeof reply.stats);
+		} else {
+			get_best_move(&next_move, &req.state, req.side,
+			  req.max_depth, req.max_msecs);
+			get_search_stats(&reply.stats);
+		}
+
+		/*
+		 * answer, then search the position after the reply we
+		 * expect until told if the opponent played it (and we can
+		 * answer again)
+		 */
+		for (;;) {
+			reply.move = next_move;
+			reply.ponder_key = 0;
+
+			if (req.ponder && get_ponder_position(&req.state,
+			  req.side, &next_move))
+				reply.ponder_key = HASH_KEY(&req.state,
+				  req.side);
+
+			/* write answer */
+			write(STDOUT_FILENO, &reply, sizeof reply);
+
+			if (reply.ponder_key == 0)
+				break;
+
+			worker_awaits_ponder_request = 1;
+
+			if (!ponder(&next_move, &req.state, req.side,
+			  req.max_depth)) {
+				worker_awaits_ponder_request = 0;
+				break;
+			}
+
+			get_search_stats(&reply.stats);
+		}
 	}
 }
 
@@ -309,9 +441,36 @@ send_worker_request(void)
 {
 	struct worker_request req;
 
+	req.max_msecs = ui_get_think_msecs();
+
+	if (the_worker.pondering) {
+		the_worker.pondering = 0;
+
+		if (HASH_KEY(&ui.board_state, ui.cur_side) ==
+		  the_worker.ponder_key) {
+			/* ponder hit, the reply comes from that search */
+			req.type = PONDER_HIT_REQUEST;
+
+			if (write_exact(the_worker.write_to_fd, &req,
+			  sizeof req) < 0)
+				return -1;
+
+			return 0;
+		}
+
+		req.type = STOP_PONDERING_REQUEST;
+
+		if (write_exact(the_worker.write_to_fd, &req, sizeof req) < 0)
+			return -1;
+	}
+
+	req.type = SEARCH_REQUEST;
 	req.state = ui.board_state;
 	req.side = ui.cur_side;
 	req.max_depth = ui.max_depth;
+	req.ponder = ui.ponder &&
+	  ui.players[ui.cur_side != BLACK_FLAG] == HUMAN_PLAYER;
+	req.mate_moves = ui.mate_moves;
 
 	if (write_exact(the_worker.write_to_fd, &req, sizeof req) < 0)
 		return -1;
@@ -319,6 +478,49 @@ send_worker_request(void)
 	return 0;
 }
 
+/*
+ * worker_move_now --
+ *	Have the worker answer right away with the best move it has found.
+ */
+void
+worker_move_now(void)
+{
+	struct worker_request req;
+
+	req.type = MOVE_NOW_REQUEST;
+
+	write_exact(the_worker.write_to_fd, &req, sizeof req);
+}
+
+/*
+ * cancel_worker_request --
+ *	Stop the search for the last request, whose reply is no longer
+ *	wanted (the game it was for is over).
+ */
+void
+cancel_worker_request(void)
+{
+	worker_move_now();
+	the_worker.cancelled_replies++;
+}
+
+/*
+ * stop_pondering --
+ *	Stop the ponder search, if any; the position it was for is gone.
+ */
+void
+stop_pondering(void)
+{
+	struct worker_request req;
+
+	if (the_worker.pondering) {
+		the_worker.pondering = 0;
+
+		req.type = STOP_PONDERING_REQUEST;
+		write_exact(the_worker.write_to_fd, &req, sizeof req);
+	}
+}
+
 static void
 init_signals(void)
 {
@@ -342,6 +544,10 @@ on_key_press(XKeyEvent *xkey)
 		case XK_Escape:
 			ui_on_escape_release();
 			break;
+
+		case XK_space:
+			ui_on_move_now();
+			break;
 	}
 }
 
@@ -429,13 +635,31 @@ on_x_event(void)
 static void
 on_x_worker_reply(void)
 {
-	union move move = {0};
+	struct worker_reply reply;
 
-	if (read_exact(the_worker.read_from_fd, &move, sizeof move) !=
-	  sizeof move)
+	if (read_exact(the_worker.read_from_fd, &reply, sizeof reply) !=
+	  sizeof reply)
 		panic("invalid data from worker");
 
-	ui_on_worker_reply(&move);
+	if (the_worker.cancelled_replies > 0) {
+		the_worker.cancelled_replies--;
+
+		if (reply.ponder_key != 0) {
+			struct worker_request req;
+
+			req.type = STOP_PONDERING_REQUEST;
+			write_exact(the_worker.write_to_fd, &req, sizeof req);
+		}
+
+		return;
+	}
+
+	the_worker.pondering = reply.ponder_key != 0;
+	the_worker.ponder_key = reply.ponder_key;
+
+	ui.search_stats = reply.stats;
+
+	ui_on_worker_reply(&reply.move);
 }
 
 void
@@ -542,7 +766,16 @@ usage(void)
 	fprintf(stderr, "  -c   computer vs. computer\n");
 	fprintf(stderr, "  -u   human vs. human\n");
 	fprintf(stderr, "  -b   play black\n");
-	fprintf(stderr, "  -d   set maximum AI search depth\n");
+	fprintf(stderr, "  -d   limit the AI search depth (by default "
+	  "only time limits it)\n");
+	fprintf(stderr, "  -s   set average AI thinking time per move, "
+	  "in seconds\n");
+	fprintf(stderr, "  -t   set number of AI search threads\n");
+	fprintf(stderr, "  -p   think on the opponent's time\n");
+	fprintf(stderr, "  -m   look for forced mates in up to this many "
+	  "moves before searching\n");
+	fprintf(stderr, "  -y   split the search tree among threads (young "
+	  "brothers wait),\n       instead of sharing only the hash table\n");
 
 	exit(1);
 }
@@ -553,13 +786,23 @@ main(int argc, char *argv[])
 	int c;
 	enum player_type white_player, black_player;
 	int max_depth;
+	long max_secs;
+	int num_threads;
+	enum parallel_search parallel_search;
+	int ponder;
+	int mate_moves;
 	char *p;
 
 	white_player = HUMAN_PLAYER;
 	black_player = COMPUTER_PLAYER;
-	max_depth = DEFAULT_MAX_DEPTH;
-
-	while ((c = getopt(argc, argv, "cubd:h")) != EOF) {
+	max_depth = MAX_SEARCH_DEPTH;
+	max_secs = DEFAULT_MAX_SECS;
+	num_threads = DEFAULT_NUM_THREADS;
+	parallel_search = LAZY_SMP;
+	ponder = 0;
+	mate_moves = 0;
+
+	while ((c = getopt(argc, argv, "cubd:s:t:pm:yh")) != EOF) {
 		switch (c) {
 			case 'c':
 				white_player = black_player = COMPUTER_PLAYER;
@@ -576,10 +819,37 @@ main(int argc, char *argv[])
 
 			case 'd':
 				max_depth = strtol(optarg, &p, 10);
-				if (p == optarg || max_depth < 1)
+				if (p == optarg || max_depth < 1 ||
+				  max_depth > MAX_SEARCH_DEPTH)
 					usage();
 				break;
 
+			case 's':
+				max_secs = strtol(optarg, &p, 10);
+				if (p == optarg || max_secs < 1)
+					usage();
+				break;
+
+			case 't':
+				num_threads = strtol(optarg, &p, 10);
+				if (p == optarg || num_threads < 1)
+					usage();
+				break;
+
+			case 'p':
+				ponder = 1;
+				break;
+
+			case 'm':
+				mate_moves = strtol(optarg, &p, 10);
+				if (p == optarg || mate_moves < 1)
+					usage();
+				break;
+
+			case 'y':
+				parallel_search = SPLIT_POINTS;
+				break;
+
 			case 'h':
 			default:
 				usage();
@@ -596,7 +866,10 @@ main(int argc, char *argv[])
 
 	XMapWindow(the_display, the_window);
 
-	ui_initialize(white_player, black_player, max_depth, WIDTH, HEIGHT);
+	ui_initialize(white_player, black_player, max_depth, max_secs*1000,
+	  num_threads, parallel_search, WIDTH, HEIGHT);
+	ui.ponder = ponder;
+	ui.mate_moves = mate_moves;
 
 	gl_initialize();
 
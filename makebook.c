@@ -0,0 +1,319 @@
+/* makebook.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/*
+ * Grows an opening book by self-play: every position reached in the
+ * first plies of each game is searched deeply, and the move found is
+ * added to the book. Moves are sometimes replaced by random ones so the
+ * games don't all follow the same line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include "panic.h"
+#include "move.h"
+#include "game.h"
+#include "engine.h"
+#include "book.h"
+
+enum {
+	DEFAULT_MAX_DEPTH = 6,
+	DEFAULT_MAX_SECS = 10,
+	DEFAULT_NUM_PLIES = 12,
+	DEFAULT_NUM_GAMES = 16,
+	DEFAULT_RANDOM_PERCENT = 20,
+	DEFAULT_NUM_THREADS = 1,
+};
+
+static struct book_entry *entries;
+static unsigned num_entries;
+static unsigned max_entries;
+
+static void
+add_entry(unsigned long long key, unsigned move, int weight, int score)
+{
+	struct book_entry *p;
+
+	if (num_entries == max_entries) {
+		max_entries = max_entries ? 2*max_entries : 1024;
+
+		if ((entries = realloc(entries,
+		  max_entries*sizeof *entries)) == NULL)
+			panic("out of memory");
+	}
+
+	if (score > SHRT_MAX)
+		score = SHRT_MAX;
+	else if (score < -SHRT_MAX)
+		score = -SHRT_MAX;
+
+	p = &entries[num_entries++];
+
+	memset(p, 0, sizeof *p);
+	p->key = key;
+	p->move = move;
+	p->weight = weight;
+	p->score = score;
+}
+
+/*
+ * load_book --
+ *	Read the entries of an existing book, if there is one at path.
+ */
+static void
+load_book(const char *path)
+{
+	FILE *in;
+	struct book_header header;
+	struct book_entry entry;
+	unsigned i;
+
+	if ((in = fopen(path, "rb")) == NULL)
+		return;
+
+	if (fread(&header, sizeof header, 1, in) != 1 ||
+	  memcmp(header.magic, BOOK_MAGIC, sizeof header.magic) ||
+	  header.byte_order != BOOK_BYTE_ORDER)
+		panic("%s is not an opening book for this machine", path);
+
+	for (i = 0; i < header.num_entries; i++) {
+		if (fread(&entry, sizeof entry, 1, in) != 1)
+			panic("%s: truncated book", path);
+
+		add_entry(entry.key, entry.move, entry.weight, entry.score);
+	}
+
+	fclose(in);
+}
+
+static int
+entry_compare(const void *p, const void *q)
+{
+	const struct book_entry *a = p, *b = q;
+
+	if (a->key != b->key)
+		return a->key < b->key ? -1 : 1;
+
+	if (a->move != b->move)
+		return a->move < b->move ? -1 : 1;
+
+	return 0;
+}
+
+/*
+ * merge_entries --
+ *	Sort entries by key and move, and merge the ones for the same move,
+ *	adding up their weights and averaging their scores.
+ */
+static void
+merge_entries(void)
+{
+	struct book_entry *p, *q, *end;
+	long weight, score_sum;
+
+	qsort(entries, num_entries, sizeof *entries, entry_compare);
+
+	end = &entries[num_entries];
+
+	for (p = q = entries; q != end; p++) {
+		*p = *q++;
+		weight = p->weight;
+		score_sum = (long)p->score*p->weight;
+
+		for (; q != end && !entry_compare(p, q); q++) {
+			weight += q->weight;
+			score_sum += (long)q->score*q->weight;
+		}
+
+		if (weight > 0)
+			p->score = score_sum/weight;
+
+		p->weight = weight > MAX_BOOK_WEIGHT ? MAX_BOOK_WEIGHT : weight;
+	}
+
+	num_entries = p - entries;
+}
+
+/*
+ * save_book --
+ *	Write the book to a temporary file, then rename it over path, so a
+ *	running game that has the old one mapped isn't disturbed.
+ */
+static void
+save_book(const char *path)
+{
+	char tmp_path[FILENAME_MAX];
+	struct book_header header;
+	FILE *out;
+
+	snprintf(tmp_path, sizeof tmp_path, "%s.tmp", path);
+
+	if ((out = fopen(tmp_path, "wb")) == NULL)
+		panic("couldn't open %s: %s", tmp_path, strerror(errno));
+
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, BOOK_MAGIC, sizeof header.magic);
+	header.byte_order = BOOK_BYTE_ORDER;
+	header.num_entries = num_entries;
+
+	if (fwrite(&header, sizeof header, 1, out) != 1 ||
+	  fwrite(entries, sizeof *entries, num_entries, out) != num_entries ||
+	  fclose(out) != 0)
+		panic("couldn't write %s: %s", tmp_path, strerror(errno));
+
+	if (rename(tmp_path, path) != 0)
+		panic("couldn't rename %s to %s: %s", tmp_path, path,
+		  strerror(errno));
+}
+
+/*
+ * play_game --
+ *	Play the first num_plies of a game against itself, adding the
+ *	searched move for every position to the book.
+ */
+static void
+play_game(int num_plies, int max_depth, long max_msecs, int random_percent)
+{
+	struct board_state state;
+	struct undo_move_info undo_info;
+	union move moves[MAX_MOVES], move;
+	int ply, side, n, score;
+
+	init_board_state(&state);
+	side = 0;
+
+	for (ply = 0; ply < num_plies; ply++) {
+		if ((n = get_legal_moves(moves, &state, side)) == 0)
+			break;
+
+		score = get_best_move(&move, &state, side, max_depth,
+		  max_msecs);
+
+		add_entry(HASH_KEY(&state, side), pack_move(&move), 1, score);
+
+		if (rand() % 100 < random_percent)
+			move = moves[rand() % n];
+
+		do_move(&state, &move, &undo_info);
+		side ^= BLACK_FLAG;
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: makebook [options] book-file\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -d depth    maximum search depth [%d]\n",
+	  DEFAULT_MAX_DEPTH);
+	fprintf(stderr, "  -s secs     maximum search time per move [%d]\n",
+	  DEFAULT_MAX_SECS);
+	fprintf(stderr, "  -p plies    plies per game [%d]\n",
+	  DEFAULT_NUM_PLIES);
+	fprintf(stderr, "  -g games    number of games [%d]\n",
+	  DEFAULT_NUM_GAMES);
+	fprintf(stderr, "  -r percent  chance of playing a random move [%d]\n",
+	  DEFAULT_RANDOM_PERCENT);
+	fprintf(stderr, "  -t threads  number of search threads [%d]\n",
+	  DEFAULT_NUM_THREADS);
+	fprintf(stderr, "  -h          this help\n");
+
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int c, i;
+	char *p;
+	int max_depth = DEFAULT_MAX_DEPTH;
+	int max_secs = DEFAULT_MAX_SECS;
+	int num_plies = DEFAULT_NUM_PLIES;
+	int num_games = DEFAULT_NUM_GAMES;
+	int random_percent = DEFAULT_RANDOM_PERCENT;
+	int num_threads = DEFAULT_NUM_THREADS;
+
+	while ((c = getopt(argc, argv, "d:s:p:g:r:t:h")) != EOF) {
+		switch (c) {
+			case 'd':
+				max_depth = strtol(optarg, &p, 10);
+				if (p == optarg || max_depth < 1)
+					usage();
+				break;
+
+			case 's':
+				max_secs = strtol(optarg, &p, 10);
+				if (p == optarg || max_secs < 1)
+					usage();
+				break;
+
+			case 'p':
+				num_plies = strtol(optarg, &p, 10);
+				if (p == optarg || num_plies < 1)
+					usage();
+				break;
+
+			case 'g':
+				num_games = strtol(optarg, &p, 10);
+				if (p == optarg || num_games < 1)
+					usage();
+				break;
+
+			case 'r':
+				random_percent = strtol(optarg, &p, 10);
+				if (p == optarg || random_percent < 0 ||
+				  random_percent > 100)
+					usage();
+				break;
+
+			case 't':
+				num_threads = strtol(optarg, &p, 10);
+				if (p == optarg || num_threads < 1)
+					usage();
+				break;
+
+			case 'h':
+			default:
+				usage();
+		}
+	}
+
+	if (optind != argc - 1)
+		usage();
+
+	srand(time(NULL));
+
+	init_hash_keys();
+	init_move_tables();
+	init_engine(num_threads, LAZY_SMP);
+
+	load_book(argv[optind]);
+
+	for (i = 0; i < num_games; i++) {
+		fprintf(stderr, "game %d of %d\n", i + 1, num_games);
+		play_game(num_plies, max_depth, max_secs*1000L,
+		  random_percent);
+	}
+
+	merge_entries();
+	save_book(argv[optind]);
+
+	fprintf(stderr, "%u entries in %s\n", num_entries, argv[optind]);
+
+	return 0;
+}
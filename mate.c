@@ -0,0 +1,242 @@
+/* mate.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/*
+ * Mate finder: depth-first proof-number search (df-pn).
+ *
+ * Every node has a proof number phi and a disproof number delta, seen
+ * from the side to move: the attacker's goal is to leave the defender
+ * with no legal moves within the given plies, the defender's is to
+ * survive them. phi of a node is the smallest delta of its children, and
+ * delta the sum of their phis. A node is proved when phi is 0 and
+ * disproved when delta is 0. The search always goes down the child with
+ * the smallest delta, with thresholds telling when to come back up
+ * because some other child has become more promising. Numbers are kept
+ * in a transposition table, keyed by position and plies left.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "panic.h"
+#include "move.h"
+#include "game.h"
+#include "mate.h"
+
+enum {
+	PN_INFINITY = 1 << 28,
+};
+
+struct mate_entry {
+	unsigned long long key;
+	int depth;			/* plies left */
+	int phi;
+	int delta;
+};
+
+static struct {
+	struct mate_entry *table;
+	unsigned long mask;
+	unsigned long nodes;
+	unsigned long max_nodes;
+	int attacker;
+} mate;
+
+static int
+lookup(unsigned long long key, int depth, int *phi, int *delta)
+{
+	struct mate_entry *p = &mate.table[key & mate.mask];
+
+	if (p->key != key || p->depth != depth)
+		return 0;
+
+	*phi = p->phi;
+	*delta = p->delta;
+
+	return 1;
+}
+
+static void
+store(unsigned long long key, int depth, int phi, int delta)
+{
+	struct mate_entry *p = &mate.table[key & mate.mask];
+
+	p->key = key;
+	p->depth = depth;
+	p->phi = phi;
+	p->delta = delta;
+}
+
+/*
+ * evaluate --
+ *	Numbers for a node about to be searched, from the table or from its
+ *	number of moves: a side with no moves has lost, and an attacker
+ *	with no plies left has failed. Otherwise each move is assumed to be
+ *	as good as any other, so disproving all of them takes one per move.
+ */
+static void
+evaluate(struct board_state *state, int side, int depth, int *phi,
+  int *delta)
+{
+	union move moves[MAX_MOVES];
+	unsigned long long key;
+	int n;
+
+	key = HASH_KEY(state, side);
+
+	if (lookup(key, depth, phi, delta))
+		return;
+
+	++mate.nodes;
+
+	n = get_legal_moves(moves, state, side);
+
+	if (n == 0 || (depth == 0 && side == mate.attacker)) {
+		*phi = PN_INFINITY;
+		*delta = 0;
+	} else if (depth == 0) {
+		*phi = 0;
+		*delta = PN_INFINITY;
+	} else {
+		*phi = 1;
+		*delta = n;
+	}
+
+	store(key, depth, *phi, *delta);
+}
+
+/*
+ * search --
+ *	Multiple iterative deepening at a node: search its children until
+ *	its phi reaches max_phi or its delta reaches max_delta. The numbers
+ *	of the children are kept here rather than looked up again in the
+ *	table, where they could be overwritten by their own subtrees. If the
+ *	node is proved and move isn't NULL, the winning move is returned in
+ *	it.
+ */
+static void
+search(union move *move, struct board_state *state, int side, int depth,
+  int max_phi, int max_delta, int *phi_ptr, int *delta_ptr)
+{
+	union move moves[MAX_MOVES];
+	int phis[MAX_MOVES], deltas[MAX_MOVES];
+	struct undo_move_info undo_info;
+	int i, n, best, phi, delta, second_delta;
+
+	++mate.nodes;
+
+	n = get_legal_moves(moves, state, side);
+
+	for (i = 0; i < n; i++) {
+		do_move(state, &moves[i], &undo_info);
+		evaluate(state, side^BLACK_FLAG, depth - 1, &phis[i],
+		  &deltas[i]);
+		undo_move(state, &undo_info);
+	}
+
+	for (;;) {
+		phi = PN_INFINITY;
+		delta = 0;
+		best = -1;
+		second_delta = PN_INFINITY;
+
+		for (i = 0; i < n; i++) {
+			if (deltas[i] < phi) {
+				second_delta = phi;
+				phi = deltas[i];
+				best = i;
+			} else if (deltas[i] < second_delta) {
+				second_delta = deltas[i];
+			}
+
+			if (phis[i] == PN_INFINITY)
+				delta = PN_INFINITY;
+			else if (delta < PN_INFINITY &&
+			  (delta += phis[i]) >= PN_INFINITY)
+				delta = PN_INFINITY - 1;
+		}
+
+		if (phi >= max_phi || delta >= max_delta ||
+		  mate.nodes >= mate.max_nodes)
+			break;
+
+		do_move(state, &moves[best], &undo_info);
+		search(NULL, state, side^BLACK_FLAG, depth - 1,
+		  max_delta - delta + phis[best],
+		  second_delta < max_phi - 1 ? second_delta + 1 : max_phi,
+		  &phis[best], &deltas[best]);
+		undo_move(state, &undo_info);
+	}
+
+	store(HASH_KEY(state, side), depth, phi, delta);
+
+	if (move != NULL && phi == 0)
+		*move = moves[best];
+
+	*phi_ptr = phi;
+	*delta_ptr = delta;
+}
+
+/*
+ * find_mate --
+ *	Look for a forced mate for side in 1, 2... max_moves moves, searching
+ *	at most max_nodes nodes with a table of at most max_bytes. If one
+ *	is found, its first move is returned in move.
+ */
+enum mate_result
+find_mate(union move *move, struct board_state *state, int side,
+  int max_moves, unsigned long max_nodes, unsigned long max_bytes)
+{
+	unsigned long size;
+	enum mate_result result;
+	int moves_to_mate, phi, delta;
+
+	for (size = 1; 2*size*sizeof *mate.table <= max_bytes; size *= 2)
+		;
+
+	if ((mate.table = calloc(size, sizeof *mate.table)) == NULL)
+		panic("out of memory");
+
+	mate.mask = size - 1;
+	mate.nodes = 0;
+	mate.max_nodes = max_nodes;
+	mate.attacker = side;
+
+	result = NO_MATE;
+
+	for (moves_to_mate = 1; moves_to_mate <= max_moves; moves_to_mate++) {
+		search(move, state, side, 2*moves_to_mate - 1, PN_INFINITY,
+		  PN_INFINITY, &phi, &delta);
+
+		if (phi == 0) {
+			result = MATE_FOUND;
+			break;
+		}
+
+		if (delta != 0) {
+			result = MATE_UNKNOWN;
+			break;
+		}
+	}
+
+	free(mate.table);
+	mate.table = NULL;
+
+	if (result == MATE_FOUND)
+		fprintf(stderr, "mate in %d, nodes: %lu\n", moves_to_mate,
+		  mate.nodes);
+	else
+		fprintf(stderr, "%s, nodes: %lu\n", result == NO_MATE ?
+		  "no mate" : "mate search out of nodes", mate.nodes);
+
+	return result;
+}
@@ -0,0 +1,31 @@
+/* mate.h -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+#ifndef MATE_H_
+#define MATE_H_
+
+enum {
+	MATE_SEARCH_NODES = 200000,	/* default node budget */
+	MATE_SEARCH_BYTES = 16 << 20,	/* default table size */
+};
+
+enum mate_result {
+	MATE_UNKNOWN,			/* out of nodes */
+	MATE_FOUND,
+	NO_MATE,			/* none within the given moves */
+};
+
+enum mate_result
+find_mate(union move *move, struct board_state *state, int side,
+  int max_moves, unsigned long max_nodes, unsigned long max_bytes);
+
+#endif /* MATE_H_ */
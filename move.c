@@ -27,15 +27,75 @@ static const int king_moves[] = { -BCOLS-1, -BCOLS, -BCOLS+1, 1,
 static int
 is_in_check_from(const struct board_state *state, int side, int king_square);
 
-static int
-find_king_square(const struct board_state *state, int side);
-
 static void
 find_pins(unsigned char pins[BLEVELS][BAREA], const struct board_state *state,
   int side, int king_square);
 
 static unsigned long amask_table[BLEVELS][BAREA];
 
+/* which piece moves to generate */
+enum {
+	CAPTURES = 1,
+	QUIET_MOVES = 2,
+	ALL_MOVES = CAPTURES|QUIET_MOVES,
+};
+
+/*
+ * Directions for sliding pieces, the ones that go towards higher squares
+ * (and higher occupancy bits) first. Rows grow southwards, towards white.
+ */
+enum direction {
+	EAST,
+	SOUTH,
+	SOUTH_WEST,
+	SOUTH_EAST,
+	WEST,
+	NORTH,
+	NORTH_EAST,
+	NORTH_WEST,
+	NUM_DIRECTIONS,
+
+	NUM_FORWARD_DIRECTIONS = WEST,
+};
+
+static const int direction_deltas[NUM_DIRECTIONS] = {
+	1, BCOLS, BCOLS-1, BCOLS+1, -1, -BCOLS, -BCOLS+1, -BCOLS-1 };
+
+static const enum direction rook_dirs[] = { EAST, WEST, SOUTH, NORTH };
+static const enum direction bishop_dirs[] = {
+	SOUTH_WEST, SOUTH_EAST, NORTH_WEST, NORTH_EAST };
+
+/*
+ * A slider is blocked by a piece on any level of a square, so whether it
+ * is blocked only depends on the occupancy, the board seen from above.
+ * ray_table has the squares from each square to the edge of the board in
+ * each direction, and ray_end the last of them.
+ */
+static unsigned long long ray_table[NUM_DIRECTIONS][BAREA];
+static unsigned char ray_end[NUM_DIRECTIONS][BAREA];
+static unsigned char bit_squares[PROJECTED_AREA];	/* square of each
+							 * occupancy bit */
+
+/* squares a knight or a king attacks from each square, and squares from
+ * which a pawn attacks each square, for each side's king */
+static unsigned long long knight_table[BAREA];
+static unsigned long long king_table[BAREA];
+static unsigned long long pawn_attackers_table[2][BAREA];
+
+/*
+ * first_blocker --
+ *	The square of the first piece in direction dir, given the pieces on
+ *	its ray.
+ */
+static inline int
+first_blocker(unsigned long long blockers, enum direction dir)
+{
+	if (dir < NUM_FORWARD_DIRECTIONS)
+		return bit_squares[__builtin_ctzll(blockers)];
+	else
+		return bit_squares[63 - __builtin_clzll(blockers)];
+}
+
 static void
 init_amask_table(void)
 {
@@ -80,6 +140,7 @@ struct move_gen_context {
 	int king_square;
 	int is_in_check;
 	int is_pinned;
+	int kinds;			/* CAPTURES, QUIET_MOVES or both */
 	union move *last_move;
 	struct position from;
 	int side;
@@ -102,14 +163,19 @@ append_move(struct move_gen_context *ctx, int level, int square)
 static inline void
 append_move_if_legal(struct move_gen_context *ctx, int level, int square)
 {
+	struct board_state *state;
 	unsigned char *from, *to;
 	unsigned char prev_to, prev_from;
+	unsigned long long prev_occupancy, prev_captured_bits;
+	unsigned long long *captured_bits;
 	int ks;
 
+	state = ctx->state;
+
 	/* try move */
 
-	from = &ctx->state->board[ctx->from.level][ctx->from.square];
-	to = &ctx->state->board[level][square];
+	from = &BOARD_SQUARE(state, ctx->from.level, ctx->from.square);
+	to = &BOARD_SQUARE(state, level, square);
 
 	prev_from = *from;
 	prev_to = *to;
@@ -117,78 +183,112 @@ append_move_if_legal(struct move_gen_context *ctx, int level, int square)
 	*from = EMPTY;
 	*to = prev_from;
 
+	prev_occupancy = state->occupancy;
+
+	if (square_is_empty(state, ctx->from.square))
+		state->occupancy &= ~SQUARE_BIT(ctx->from.square);
+
+	state->occupancy |= SQUARE_BIT(square);
+
+	/* the piece bits of our own pieces don't matter here, but a captured
+	 * piece doesn't attack the king any more */
+	captured_bits = NULL;
+	prev_captured_bits = 0ULL;
+
+	if (prev_to != EMPTY) {
+		captured_bits = &PIECE_BITS(state, prev_to & BLACK_FLAG,
+		  prev_to & PIECE_MASK);
+		prev_captured_bits = *captured_bits;
+
+		if (!has_piece_at(state, square, prev_to & ~MOVED_FLAG))
+			*captured_bits &= ~SQUARE_BIT(square);
+	}
+
 	/* leads to check? */
 
 	ks = ((prev_from & PIECE_MASK) == KING) ? square : ctx->king_square;
 
 /*
-	if (ks != find_king_square(ctx->state, ctx->side)) {
+	if (ks != KING_POS(ctx->state, ctx->side).square) {
 		printf("%d --> %d, %d, side = %d, ks = %d, square = %d | %d %d\n", ctx->from.square, square, prev_from, ctx->side, ks, square, ctx->king_square,
-		  find_king_square(ctx->state, ctx->side));
+		  KING_POS(ctx->state, ctx->side).square);
 		printf("%d %d\n", *from, *to);
 		assert(0);
 	}
 */
 
-	if (!is_in_check_from(ctx->state, ctx->side, ks))
+	if (!is_in_check_from(state, ctx->side, ks))
 		append_move(ctx, level, square);
 
 	/* undo move */
 
 	*from = prev_from;
 	*to = prev_to;
+	state->occupancy = prev_occupancy;
+
+	if (captured_bits != NULL)
+		*captured_bits = prev_captured_bits;
 }
 
-static inline int
+static inline void
 append_squares_at(struct move_gen_context *ctx, int square)
 {
-	int blocked;
 	int l;
 	unsigned long amask;
 	struct board_state *state;
 
 	state = ctx->state;
-	amask = state->attack_board_bits;
 
-	blocked = 0;
+#ifndef LEVEL_MAJOR_BOARD
+	/* nothing to capture */
+	if (!(ctx->kinds & QUIET_MOVES) && square_is_empty(state, square))
+		return;
+#endif
+
+	amask = state->attack_board_bits;
 
 	for (l = 0; l < BLEVELS; l++) {
 		const unsigned long m = amask_table[l][square];
 
 		if (m != ~0UL && (amask & m) == m) {
-			const unsigned char s = state->board[l][square];
+			const unsigned char s = BOARD_SQUARE(state, l, square);
 
 			assert(s != INVALID);
 
-			if (s == EMPTY || (s & BLACK_FLAG) != ctx->side) {
+			if (s == EMPTY ? (ctx->kinds & QUIET_MOVES) :
+			  (s & BLACK_FLAG) != ctx->side &&
+			    (ctx->kinds & CAPTURES)) {
 				if (!ctx->is_in_check && !ctx->is_pinned)
 					append_move(ctx, l, square);
 				else
 					append_move_if_legal(ctx, l, square);
 			}
-
-			if (s != EMPTY)
-				blocked = 1;
 		}
 	}
-
-	return blocked;
 }
 
 static inline void
-follow_dir(struct move_gen_context *ctx, int delta)
+follow_dir(struct move_gen_context *ctx, enum direction dir)
 {
-	int cur;
-	struct board_state *state;
+	int cur, last;
+	unsigned long long blockers;
+	const int from = ctx->from.square, delta = direction_deltas[dir];
 
-	state = ctx->state;
-	cur = ctx->from.square + delta;
+	blockers = ray_table[dir][from] & ctx->state->occupancy;
 
-	while (state->board[0][cur] != INVALID) {
-		if (append_squares_at(ctx, cur))
-			break;
+	if (blockers)
+		last = first_blocker(blockers, dir);
+	else if (ctx->kinds & QUIET_MOVES)
+		last = ray_end[dir][from];
+	else
+		return;
 
+	/* only the first piece in the way can be captured */
+	cur = (ctx->kinds & QUIET_MOVES) ? from : last - delta;
+
+	while (cur != last) {
 		cur += delta;
+		append_squares_at(ctx, cur);
 	}
 }
 
@@ -200,13 +300,14 @@ walk_king(struct move_gen_context *ctx)
 	for (i = 0; i < sizeof king_moves / sizeof *king_moves; i++) {
 		square = ctx->from.square + king_moves[i];
 
-		if (ctx->state->board[0][square] != INVALID)
+		if (BOARD_SQUARE(ctx->state, 0, square) != INVALID)
 			append_squares_at(ctx, square);
 	}
 
 	/* castling */
 
-	if (!ctx->is_in_check && ctx->state->cur_ply > 1) {
+	if (!ctx->is_in_check && (ctx->kinds & QUIET_MOVES) &&
+	  ctx->state->cur_ply > 1) {
 		struct board_state *state = ctx->state;
 		union move *last_move = ctx->last_move;
 		const unsigned castling_rights = state->castling_rights;
@@ -219,7 +320,7 @@ walk_king(struct move_gen_context *ctx)
 			}
 
 			if ((castling_rights & CR_BLACK_QUEENSIDE) &&
-			  state->board[0][2*BCOLS+2] == EMPTY &&
+			  BOARD_SQUARE(state, 0, 2*BCOLS+2) == EMPTY &&
 			  !is_in_check_from(state, BLACK_FLAG, 2*BCOLS+2)) {
 				last_move->type = BLACK_QUEENSIDE_CASTLING;
 				++last_move;
@@ -232,7 +333,7 @@ walk_king(struct move_gen_context *ctx)
 			}
 
 			if (castling_rights & CR_WHITE_QUEENSIDE &&
-			  state->board[4][11*BCOLS+2] == EMPTY &&
+			  BOARD_SQUARE(state, 4, 11*BCOLS+2) == EMPTY &&
 			  !is_in_check_from(state, 0, 11*BCOLS+2)) {
 				last_move->type = WHITE_QUEENSIDE_CASTLING;
 				++last_move;
@@ -251,7 +352,7 @@ walk_knight(struct move_gen_context *ctx)
 	for (i = 0; i < sizeof knight_moves / sizeof *knight_moves; i++) {
 		square = ctx->from.square + knight_moves[i];
 
-		if (ctx->state->board[0][square] != INVALID)
+		if (BOARD_SQUARE(ctx->state, 0, square) != INVALID)
 			append_squares_at(ctx, square);
 	}
 }
@@ -273,7 +374,7 @@ append_squares_no_capture(struct move_gen_context *ctx, int square)
 		const unsigned long m = amask_table[l][square];
 
 		if (m != ~0UL && (amask & m) == m) {
-			const unsigned char s = state->board[l][square];
+			const unsigned char s = BOARD_SQUARE(state, l, square);
 
 			assert(s != INVALID);
 
@@ -296,11 +397,16 @@ append_squares_capture_only(struct move_gen_context *ctx, int square, int side)
 
 	state = ctx->state;
 
+#ifndef LEVEL_MAJOR_BOARD
+	if (square_is_empty(state, square))
+		return;
+#endif
+
 	for (l = 0; l < BLEVELS; l++) {
 		const unsigned long m = amask_table[l][square];
 
 		if (m != ~0UL && (state->attack_board_bits & m) == m) {
-			const unsigned char s = state->board[l][square];
+			const unsigned char s = BOARD_SQUARE(state, l, square);
 
 			assert(s != INVALID);
 
@@ -320,19 +426,26 @@ walk_black_pawn(struct move_gen_context *ctx, int moved)
 	state = ctx->state;
 	from = ctx->from.square;
 
-	blocked = 1;
+	if (ctx->kinds & QUIET_MOVES) {
+		blocked = 1;
 
-	if (state->board[0][from + BCOLS] != INVALID)
-		blocked = append_squares_no_capture(ctx, from + BCOLS);
+		if (BOARD_SQUARE(state, 0, from + BCOLS) != INVALID)
+			blocked = append_squares_no_capture(ctx,
+			  from + BCOLS);
 
-	if (!moved && !blocked && state->board[0][from + 2*BCOLS] != INVALID)
-		append_squares_no_capture(ctx, from + 2*BCOLS);
+		if (!moved && !blocked &&
+		  BOARD_SQUARE(state, 0, from + 2*BCOLS) != INVALID)
+			append_squares_no_capture(ctx, from + 2*BCOLS);
+	}
+
+	if (!(ctx->kinds & CAPTURES))
+		return;
 
-	if (state->board[0][from + BCOLS + 1] != INVALID)
+	if (BOARD_SQUARE(state, 0, from + BCOLS + 1) != INVALID)
 		append_squares_capture_only(ctx, from + BCOLS + 1,
 		  BLACK_FLAG);
 
-	if (state->board[0][from + BCOLS - 1] != INVALID)
+	if (BOARD_SQUARE(state, 0, from + BCOLS - 1) != INVALID)
 		append_squares_capture_only(ctx, from + BCOLS - 1,
 		  BLACK_FLAG);
 }
@@ -347,25 +460,107 @@ walk_white_pawn(struct move_gen_context *ctx, int moved)
 	state = ctx->state;
 	from = ctx->from.square;
 
-	blocked = 1;
+	if (ctx->kinds & QUIET_MOVES) {
+		blocked = 1;
+
+		if (BOARD_SQUARE(state, 0, from - BCOLS) != INVALID)
+			blocked = append_squares_no_capture(ctx,
+			  from - BCOLS);
 
-	if (state->board[0][from - BCOLS] != INVALID)
-		blocked = append_squares_no_capture(ctx, from - BCOLS);
+		if (!moved && !blocked &&
+		  BOARD_SQUARE(state, 0, from - 2*BCOLS) != INVALID)
+			append_squares_no_capture(ctx, from - 2*BCOLS);
+	}
 
-	if (!moved && !blocked && state->board[0][from - 2*BCOLS] != INVALID)
-		append_squares_no_capture(ctx, from - 2*BCOLS);
+	if (!(ctx->kinds & CAPTURES))
+		return;
 
-	if (state->board[0][from - BCOLS + 1] != INVALID)
+	if (BOARD_SQUARE(state, 0, from - BCOLS + 1) != INVALID)
 		append_squares_capture_only(ctx, from - BCOLS + 1, 0);
 
-	if (state->board[0][from - BCOLS - 1] != INVALID)
+	if (BOARD_SQUARE(state, 0, from - BCOLS - 1) != INVALID)
 		append_squares_capture_only(ctx, from - BCOLS - 1, 0);
 }
 
+/*
+ * is_on_board --
+ *	True if square is on the board seen from above: all of it but the
+ *	squares between the attack boards at either end.
+ */
+static int
+is_on_board(int square)
+{
+	const int row = square/BCOLS, col = square%BCOLS;
+
+	if (row < 2 || row >= BROWS - 2 || col < 1 || col >= BCOLS - 1)
+		return 0;
+
+	return !((row == 2 || row == BROWS - 3) && (col == 3 || col == 4));
+}
+
+/*
+ * get_step_bits --
+ *	The squares on the board one of the n deltas away from square.
+ */
+static unsigned long long
+get_step_bits(int square, const int *deltas, int n)
+{
+	int i;
+	unsigned long long bits;
+
+	bits = 0ULL;
+
+	for (i = 0; i < n; i++) {
+		if (is_on_board(square + deltas[i]))
+			bits |= SQUARE_BIT(square + deltas[i]);
+	}
+
+	return bits;
+}
+
+static void
+init_attack_tables(void)
+{
+	static const int white_pawn_attackers[] = { BCOLS+1, BCOLS-1 };
+	static const int black_pawn_attackers[] = { -BCOLS+1, -BCOLS-1 };
+	int i, square, cur;
+	unsigned long long ray;
+
+	for (square = 0; square < BAREA; square++) {
+		if (!is_on_board(square))
+			continue;
+
+		bit_squares[__builtin_ctzll(SQUARE_BIT(square))] = square;
+
+		knight_table[square] = get_step_bits(square, knight_moves,
+		  sizeof knight_moves/sizeof *knight_moves);
+		king_table[square] = get_step_bits(square, king_moves,
+		  sizeof king_moves/sizeof *king_moves);
+
+		/* white pawns capture northwards, black ones southwards */
+		pawn_attackers_table[0][square] = get_step_bits(square,
+		  black_pawn_attackers, 2);
+		pawn_attackers_table[1][square] = get_step_bits(square,
+		  white_pawn_attackers, 2);
+
+		for (i = 0; i < NUM_DIRECTIONS; i++) {
+			ray = 0ULL;
+
+			for (cur = square + direction_deltas[i];
+			  is_on_board(cur); cur += direction_deltas[i])
+				ray |= SQUARE_BIT(cur);
+
+			ray_table[i][square] = ray;
+			ray_end[i][square] = cur - direction_deltas[i];
+		}
+	}
+}
+
 void
 init_move_tables(void)
 {
 	init_amask_table();
+	init_attack_tables();
 }
 
 static inline void
@@ -382,10 +577,10 @@ get_next_moves_for_piece(struct move_gen_context *ctx, int piece, int moved)
 	switch (piece) {
 		case ROOK:
 		case QUEEN:
-  			follow_dir(ctx, -BCOLS);
-  			follow_dir(ctx, BCOLS);
-  			follow_dir(ctx, 1);
-  			follow_dir(ctx, -1);
+  			follow_dir(ctx, NORTH);
+  			follow_dir(ctx, SOUTH);
+  			follow_dir(ctx, EAST);
+  			follow_dir(ctx, WEST);
 
 			if (piece == ROOK)
 				break;
@@ -393,10 +588,10 @@ get_next_moves_for_piece(struct move_gen_context *ctx, int piece, int moved)
 			/* fallthrough for queen */
 
 		case BISHOP:
-  			follow_dir(ctx, -BCOLS - 1);
-  			follow_dir(ctx, -BCOLS + 1);
-  			follow_dir(ctx, BCOLS - 1);
-  			follow_dir(ctx, BCOLS + 1);
+  			follow_dir(ctx, NORTH_WEST);
+  			follow_dir(ctx, NORTH_EAST);
+  			follow_dir(ctx, SOUTH_WEST);
+  			follow_dir(ctx, SOUTH_EAST);
 			break;
 
 		case KING:
@@ -509,11 +704,8 @@ static int
 is_legal_move(const union move *move, struct board_state *state, int side)
 {
 	struct undo_move_info undo_info;
-	struct board_state temp;
 	int r;
 
-	temp = *state;
-
 	do_move(state, move, &undo_info);
 	r = !is_in_check(state, side);
 	undo_move(state, &undo_info);
@@ -528,13 +720,13 @@ get_legal_moves_for_position(union move *moves,
 	int p, npos, i;
 	union move *last_move;
 
-	p = state->board[from_pos->level][from_pos->square];
+	p = BOARD_SQUARE(state, from_pos->level, from_pos->square);
 
 	last_move = moves;
 
 	if (p != EMPTY) {
 		int piece, moved;
-		static struct move_gen_context ctx;
+		struct move_gen_context ctx;
 
 		/* piece moves */
 		if ((p & BLACK_FLAG) == side) {
@@ -542,12 +734,13 @@ get_legal_moves_for_position(union move *moves,
 			moved = p & MOVED_FLAG;
 
 			ctx.state = state;
-			ctx.king_square = find_king_square(state, side);
+			ctx.king_square = KING_POS(state, side).square;
 			ctx.is_in_check = is_in_check_from(state, side,
 			  ctx.king_square);
 			find_pins(ctx.pins, state, side, ctx.king_square);
 			ctx.last_move = moves;
 			ctx.side = side;
+			ctx.kinds = ALL_MOVES;
 			ctx.from = *from_pos;
 			ctx.is_pinned = (piece == KING) ||
 			  ctx.pins[from_pos->level][from_pos->square];
@@ -585,80 +778,48 @@ get_legal_moves_for_position(union move *moves,
 	return last_move - moves;
 }
 
-static void
-get_legal_piece_moves_for_board(struct move_gen_context *ctx,
-  struct position *first, int size)
-{
-	int i, j;
-	int square, level;
-	unsigned char p;
-	unsigned char *from;
-	struct board_state *state;
-	int king_square;
-	int side;
-
-	state = ctx->state;
-	king_square = ctx->king_square;
-	side = ctx->side;
-
-	level = first->level;
-	square = first->square;
-
-	for (i = 0; i < size; i++) {
-		for (j = 0; j < size; j++) {
-			from = &state->board[level][square];
-			p = *from;
-
-			if (p != EMPTY && (p & BLACK_FLAG) == side) {
-				ctx->from.level = level;
-				ctx->from.square = square;
-				ctx->is_pinned = ((p&PIECE_MASK) == KING) ||
-				  ctx->pins[level][square];
-
-				get_next_moves_for_piece(ctx, p&PIECE_MASK,
-				  p&MOVED_FLAG);
-			}
-
-			++square;
-		}
-
-		square += BCOLS - size;
-	}
-}
-
 static int
-get_legal_piece_moves(union move *moves, struct board_state *state, int side)
+get_legal_piece_moves(union move *moves, struct board_state *state, int side,
+  int kinds)
 {
-	int i, j;
-	struct position first;
-	static struct move_gen_context ctx;
+	const struct position *pos;
+	struct move_gen_context ctx;
+	unsigned in_play;
+	unsigned char p;
+	int slot;
 
 	ctx.state = state;
-	ctx.king_square = find_king_square(state, side);
+	ctx.king_square = KING_POS(state, side).square;
 	ctx.is_in_check = is_in_check_from(state, side, ctx.king_square);
 	find_pins(ctx.pins, state, side, ctx.king_square);
 	ctx.last_move = moves;
 	ctx.side = side;
+	ctx.kinds = kinds;
 
-	for (i = 0; i < NUM_MAIN_BOARDS; i++) {
-		get_main_board_position(&first, i);
+	in_play = PIECES_IN_PLAY(state, side);
 
-		get_legal_piece_moves_for_board(&ctx, &first, MAIN_BOARD_SIZE);
+	for (slot = 0; in_play != 0; slot++, in_play >>= 1) {
+		if (!(in_play & 1))
+			continue;
 
-		for (j = 0; j < 8; j++) {
-			if (ATTACK_BOARD_IS_ACTIVE(state, i, j)) {
-				get_attack_board_position(&first, i, j);
+		pos = &PIECES(state, side)[slot];
+		p = BOARD_SQUARE(state, pos->level, pos->square);
 
-				get_legal_piece_moves_for_board(&ctx, &first,
-				  ATTACK_BOARD_SIZE);
-			}
-		}
+		ctx.from = *pos;
+		ctx.is_pinned = (p & PIECE_MASK) == KING ||
+		  ctx.pins[pos->level][pos->square];
+
+		get_next_moves_for_piece(&ctx, p & PIECE_MASK, p & MOVED_FLAG);
 	}
 
 	return ctx.last_move - moves;
 }
 
-static int
+/*
+ * get_legal_attack_board_moves --
+ *	Like get_legal_moves, but only attack board moves.
+ */
+int
 get_legal_attack_board_moves(union move *moves, struct board_state *state,
   int side)
 {
@@ -703,7 +864,7 @@ eval_legal_moves(union move *moves, struct board_state *state, int side)
 {
 	int n;
 
-	n = get_legal_piece_moves(moves, state, side);
+	n = get_legal_piece_moves(moves, state, side, ALL_MOVES);
 	n += get_legal_attack_board_moves(&moves[n], state, side);
 
 /*
@@ -730,48 +891,136 @@ get_legal_moves(union move *moves, struct board_state *state, int side)
 	return eval_legal_moves(moves, state, side);
 }
 
-static int
-find_piece_at(const struct board_state *state, int square, int piece, int side)
+/*
+ * get_legal_captures --
+ *	Like get_legal_moves, but only piece moves that capture.
+ */
+int
+get_legal_captures(union move *moves, struct board_state *state, int side)
 {
-	int blocked;
-	int l;
+	return get_legal_piece_moves(moves, state, side, CAPTURES);
+}
 
-	blocked = 0;
+/*
+ * get_legal_quiet_moves --
+ *	Like get_legal_moves, but only piece moves that don't capture
+ *	(castling included).
+ */
+int
+get_legal_quiet_moves(union move *moves, struct board_state *state, int side)
+{
+	return get_legal_piece_moves(moves, state, side, QUIET_MOVES);
+}
 
-	for (l = 0; l < BLEVELS; l++) {
-		const unsigned char s = state->board[l][square] & ~MOVED_FLAG;
+/*
+ * is_valid_move --
+ *	Whether move, a move for some position (say, one from the
+ *	transposition table), is legal in this one. Only the moves of the
+ *	piece or attack board involved are generated.
+ */
+int
+is_valid_move(const union move *move, struct board_state *state, int side)
+{
+	union move moves[MAX_MOVES];
+	struct attack_board positions[MAX_MOVES];
+	const struct piece_move *pm;
+	const struct attack_board_move *am;
+	struct move_gen_context ctx;
+	const union move *p;
+	unsigned long m;
+	unsigned char s;
+	int i, n;
 
-		if (s == (piece|side) || s == (QUEEN|side) /* HACK */)
-			return 1;
+	switch (move->type) {
+		case PIECE_MOVE:
+			pm = &move->piece_move;
+			s = BOARD_SQUARE(state, pm->from.level,
+			  pm->from.square);
+			m = amask_table[pm->from.level][pm->from.square];
+
+			/* on a board that's there, and one of ours? */
+			if (m == ~0UL || (state->attack_board_bits & m) != m ||
+			  s == EMPTY || (s & BLACK_FLAG) != side)
+				return 0;
+
+			/*
+			 * look for the move among the piece's moves, not
+			 * minding checks, then try it
+			 */
+			ctx.state = state;
+			ctx.king_square = KING_POS(state, side).square;
+			ctx.is_in_check = 0;
+			ctx.is_pinned = 0;
+			ctx.kinds = ALL_MOVES;
+			ctx.last_move = moves;
+			ctx.from = pm->from;
+			ctx.side = side;
 
-		if (s != EMPTY)
-			blocked = -1;
-	}
+			get_next_moves_for_piece(&ctx, s & PIECE_MASK,
+			  s & MOVED_FLAG);
 
-	return blocked;
-}
+			/* castling entries have no squares */
+			for (p = moves; p != ctx.last_move; p++) {
+				if (p->type == PIECE_MOVE &&
+				  SAME_POS(&p->piece_move.to, &pm->to))
+					return is_legal_move(move, state, side);
+			}
 
-static int
-find_piece_on_dir(const struct board_state *state, int from, int delta,
-  int piece, int side)
-{
-	int cur, s;
+			return 0;
 
-	cur = from + delta;
+		case ATTACK_BOARD_MOVE:
+			am = &move->attack_board_move;
 
-	while (state->board[0][cur] != INVALID) {
-		s = find_piece_at(state, cur, piece, side);
+			if (!ATTACK_BOARD_IS_ACTIVE(state, am->from.main_board,
+			  am->from.position) ||
+			  ATTACK_BOARD_SIDE(state, am->from.main_board,
+			    am->from.position) != side)
+				return 0;
 
-		if (s == 1)
-			return 1;
+			n = get_next_positions_for_attack_board(positions,
+			  state, &am->from, side);
 
-		if (s == -1)
-			break;
+			for (i = 0; i < n; i++) {
+				if (positions[i].main_board ==
+				  am->to.main_board &&
+				  positions[i].position == am->to.position)
+					return is_legal_move(move, state, side);
+			}
 
-		cur += delta;
+			return 0;
+
+		default:
+			/* castling: generate the king's moves */
+			n = get_legal_moves_for_position(moves,
+			  &KING_POS(state, side), state, side);
+
+			for (i = 0; i < n; i++) {
+				if (moves[i].type == move->type)
+					return 1;
+			}
+
+			return 0;
 	}
+}
 
-	return 0;
+/*
+ * slider_on_dir --
+ *	True if the first square in the way in direction dir from square is
+ *	one of sliders. A piece anywhere on a square sees through its other
+ *	levels.
+ */
+static inline int
+slider_on_dir(const struct board_state *state, int square,
+  enum direction dir, unsigned long long sliders)
+{
+	unsigned long long blockers;
+
+	if (!(ray_table[dir][square] & sliders))
+		return 0;
+
+	blockers = ray_table[dir][square] & state->occupancy;
+
+	return (SQUARE_BIT(first_blocker(blockers, dir)) & sliders) != 0;
 }
 
 int
@@ -780,11 +1029,11 @@ is_in_check_expensive(struct board_state *state, int side)
 	union move moves[600];
 	int i, n;
 
-	n = get_legal_piece_moves(moves, state, side ^ BLACK_FLAG);
+	n = get_legal_piece_moves(moves, state, side ^ BLACK_FLAG, ALL_MOVES);
 
 	for (i = 0; i < n; i++) {
-		assert((state->board[moves[i].piece_move.to.level]
-		  [moves[i].piece_move.to.square] & ~MOVED_FLAG)
+		assert((BOARD_SQUARE(state, moves[i].piece_move.to.level,
+		  moves[i].piece_move.to.square) & ~MOVED_FLAG)
 		    != (KING|side));
 	}
 
@@ -793,181 +1042,101 @@ is_in_check_expensive(struct board_state *state, int side)
 
 static void
 find_pin_on_dir(unsigned char pins[BLEVELS][BAREA],
-  const struct board_state *state, int king_square, int delta, int piece,
-    int side)
-{
-	int cur, l;
-	int pin_level, pin_square;
-
-	cur = king_square + delta;
-	pin_level = pin_square = -1;
-
-	while (state->board[0][cur] != INVALID) {
-		for (l = 0; l < BLEVELS; l++) {
-			const unsigned char s = state->board[l][cur];
-
-			if (s != EMPTY) {
-				if ((s & BLACK_FLAG) == side) {
-					if (pin_level != -1)
-						return;
-
-					pin_level = l;
-					pin_square = cur;
-				} else {
-					if (pin_level != -1 &&
-					  pin_square != cur &&
-					  ((s & PIECE_MASK) == piece ||
-					  (s & PIECE_MASK) == QUEEN)) {
-						pins[pin_level][pin_square] = 1;
-					}
-
-					return;
-				}
-			}
-		}
+  const struct board_state *state, int king_square, enum direction dir,
+    unsigned long long sliders, int side)
+{
+	int pin_square, pin_level, l;
+	unsigned long long blockers;
 
-		cur += delta;
+	if (!(ray_table[dir][king_square] & sliders))
+		return;
+
+	/* the first square in the way must hold a single piece of ours */
+
+	blockers = ray_table[dir][king_square] & state->occupancy;
+	pin_square = first_blocker(blockers, dir);
+	pin_level = -1;
+
+	for (l = 0; l < BLEVELS; l++) {
+		const unsigned char s = BOARD_SQUARE(state, l, pin_square);
+
+		if (s != EMPTY) {
+			if ((s & BLACK_FLAG) != side || pin_level != -1)
+				return;
+
+			pin_level = l;
+		}
 	}
-}
 
-static const int bishop_dirs[] = { BCOLS-1, BCOLS+1, -BCOLS-1, -BCOLS+1 };
-static const int rook_dirs[] = { 1, -1, BCOLS, -BCOLS };
+	/* with an attacker right behind it */
+
+	if (slider_on_dir(state, pin_square, dir, sliders))
+		pins[pin_level][pin_square] = 1;
+}
 
 static void
 find_pins(unsigned char pins[BLEVELS][BAREA], const struct board_state *state,
   int side, int king_square)
 {
 	int i;
+	unsigned long long straight_sliders, diagonal_sliders;
+
+	memset(pins, 0, BLEVELS*sizeof *pins);
 
-	memset(pins, 0, sizeof pins);
+	straight_sliders = PIECE_BITS(state, side ^ BLACK_FLAG, ROOK) |
+	  PIECE_BITS(state, side ^ BLACK_FLAG, QUEEN);
+	diagonal_sliders = PIECE_BITS(state, side ^ BLACK_FLAG, BISHOP) |
+	  PIECE_BITS(state, side ^ BLACK_FLAG, QUEEN);
 
 	for (i = 0; i < 4; i++) {
 		find_pin_on_dir(pins, state, king_square, rook_dirs[i],
-		  ROOK, side);
+		  straight_sliders, side);
 
 		find_pin_on_dir(pins, state, king_square, bishop_dirs[i],
-		  BISHOP, side);
+		  diagonal_sliders, side);
 	}
 }
 
 static int
 is_in_check_from(const struct board_state *state, int side, int king_square)
 {
-	int next;
-	int i, j;
-	int pawn_capture_dir[2];
-	int s;
-	unsigned long amask;
+	int i, enemy;
+	unsigned long long straight_sliders, diagonal_sliders;
 
-	amask = state->attack_board_bits;
+	enemy = side ^ BLACK_FLAG;
+
+	/* check by knight, pawn or king? */
+
+	if ((knight_table[king_square] & PIECE_BITS(state, enemy, KNIGHT)) ||
+	  (pawn_attackers_table[side == BLACK_FLAG][king_square] &
+	    PIECE_BITS(state, enemy, PAWN)) ||
+	  (king_table[king_square] & PIECE_BITS(state, enemy, KING)))
+		return 1;
 
 	/* check by bishop, rook or queen? */
 
+	straight_sliders = PIECE_BITS(state, enemy, ROOK) |
+	  PIECE_BITS(state, enemy, QUEEN);
+	diagonal_sliders = PIECE_BITS(state, enemy, BISHOP) |
+	  PIECE_BITS(state, enemy, QUEEN);
+
 	for (i = 0; i < 4; i++) {
 		/* check straight line */
-		if (find_piece_on_dir(state, king_square, rook_dirs[i],
-		  ROOK, side ^ BLACK_FLAG)) {
+		if (slider_on_dir(state, king_square, rook_dirs[i],
+		  straight_sliders))
 			return 1;
-		}
 
 		/* check diagonal */
-		if (find_piece_on_dir(state, king_square, bishop_dirs[i],
-		  BISHOP, side ^ BLACK_FLAG)) {
+		if (slider_on_dir(state, king_square, bishop_dirs[i],
+		  diagonal_sliders))
 			return 1;
-		}
-	}
-
-	/* check by knight */
-
-	for (i = 0; i < sizeof knight_moves/sizeof *knight_moves; i++) {
-		next = king_square + knight_moves[i];
-
-		for (j = 0; j < BLEVELS; j++) {
-			s = state->board[j][next];
-
-			if (s == INVALID)
-				break;
-
-			if ((s & ~MOVED_FLAG) == (KNIGHT|(side ^ BLACK_FLAG)))
-				return 1;
-		}
-	}
-
-	/* check by pawn */
-
-	if (side == BLACK_FLAG) {
-		pawn_capture_dir[0] = BCOLS+1;
-		pawn_capture_dir[1] = BCOLS-1;
-	} else {
-		pawn_capture_dir[0] = -BCOLS+1;
-		pawn_capture_dir[1] = -BCOLS-1;
-	}
-
-	for (i = 0; i < 2; i++) {
-		next = king_square + pawn_capture_dir[i];
-
-		for (j = 0; j < BLEVELS; j++) {
-			s = state->board[j][next];
-
-			if (s == INVALID)
-				break;
-
-			if ((s & ~MOVED_FLAG) == (PAWN|(side ^ BLACK_FLAG)))
-				return 1;
-		}
-	}
-
-	/* check by king */
-
-	for (i = 0; i < sizeof king_moves/sizeof *king_moves; i++) {
-		next = king_square + king_moves[i];
-
-		for (j = 0; j < BLEVELS; j++) {
-			s = state->board[j][next];
-
-			if (s == INVALID)
-				break;
-
-			if ((s & ~MOVED_FLAG) == (KING|(side ^ BLACK_FLAG)))
-				return 1;
-		}
 	}
 
 	return 0;
 }
 
-static int
-find_king_square(const struct board_state *state, int side)
-{
-	int king_square;
-	int i, j, s;
-
-	/* find king */
-
-	king_square = -1;
-
-	for (j = 0; j < BAREA; j++) {
-		for (i = 0; i < BLEVELS; i++) {
-			s = state->board[i][j];
-
-			if (s == INVALID)
-				break;
-
-			if ((s & PIECE_MASK) == KING &&
-			  (s & BLACK_FLAG) == side) {
-				king_square = j;
-				break;
-			}
-		}
-	}
-
-	assert(king_square != -1);
-
-	return king_square;
-}
-
 int
 is_in_check(const struct board_state *state, int side)
 {
-	return is_in_check_from(state, side, find_king_square(state, side));
+	return is_in_check_from(state, side, KING_POS(state, side).square);
 }
@@ -29,6 +29,19 @@ get_legal_moves_for_position(union move *moves,
 int
 get_legal_moves(union move *moves, struct board_state *state, int side);
 
+int
+get_legal_captures(union move *moves, struct board_state *state, int side);
+
+int
+get_legal_quiet_moves(union move *moves, struct board_state *state, int side);
+
+int
+get_legal_attack_board_moves(union move *moves, struct board_state *state,
+  int side);
+
+int
+is_valid_move(const union move *move, struct board_state *state, int side);
+
 int
 is_in_check(const struct board_state *state, int side);
 
@@ -17,4 +17,8 @@
 #define TEXTURE_DIR DATA_DIR"/textures"
 #endif
 
+#ifndef BOOK_PATH
+#define BOOK_PATH DATA_DIR"/book.bin"
+#endif
+
 #endif /* PATHNAMES_H_ */
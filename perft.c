@@ -0,0 +1,351 @@
+/* perft.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/*
+ * Counts the leaf nodes of the tree of legal moves to a given depth, per
+ * root move ("divide"), to check the move generator against known counts
+ * and to time it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "panic.h"
+#include "move.h"
+#include "game.h"
+
+enum {
+	DEFAULT_NUM_THREADS = 1,
+	MAX_THREADS = 64,
+	MAX_DEPTH = 255,
+};
+
+/*
+ * Subtree counts, keyed by position and depth. Entries are written
+ * without locking: check is the key xor'ed with data, so an entry
+ * half written by another thread just doesn't match.
+ */
+struct perft_entry {
+	unsigned long long check;
+	unsigned long long data;	/* count << 8 | depth */
+};
+
+/* the moves of the last node a thread visited at some depth */
+struct last_moves {
+	int n;
+	union move moves[MAX_MOVES];
+};
+
+static struct {
+	struct perft_entry *table;
+	unsigned long mask;
+	int check_moves;		/* verify the generated moves */
+
+	/* root moves, taken in order by the threads */
+	struct board_state state;
+	int side;
+	int depth;
+	union move moves[MAX_MOVES];
+	unsigned long long counts[MAX_MOVES];
+	int num_moves;
+	int next_move;
+	pthread_mutex_t lock;
+} perft;
+
+static long
+get_msecs(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec*1000L + tv.tv_usec/1000L;
+}
+
+/*
+ * check_moves --
+ *	The generator should only return moves that don't leave the king
+ *	in check.
+ */
+static void
+check_moves(const union move *moves, int n, struct board_state *state,
+  int side)
+{
+	struct undo_move_info undo_info;
+	char move_str[80];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		/* the move reads the from square, which do_move empties */
+		strcpy(move_str, move_as_string(state, &moves[i]));
+
+		do_move(state, &moves[i], &undo_info);
+
+		if (is_in_check(state, side))
+			panic("illegal move generated: %s", move_str);
+
+		undo_move(state, &undo_info);
+	}
+}
+
+/*
+ * check_valid_moves --
+ *	is_valid_move, which the search uses on hash moves and killers,
+ *	should accept the generated moves and nothing else. The moves of
+ *	the last node at the same depth stand in for killers, which come
+ *	from sibling positions.
+ */
+static void
+check_valid_moves(const union move *moves, int n,
+  const struct last_moves *last, struct board_state *state, int side)
+{
+	unsigned packed;
+	int i, j;
+
+	for (i = 0; i < n; i++) {
+		if (!is_valid_move(&moves[i], state, side))
+			panic("legal move not valid: %s",
+			  move_as_long_string(state, &moves[i]));
+	}
+
+	for (i = 0; i < last->n; i++) {
+		packed = pack_move(&last->moves[i]);
+
+		for (j = 0; j < n; j++) {
+			if (pack_move(&moves[j]) == packed)
+				break;
+		}
+
+		if (j == n && is_valid_move(&last->moves[i], state, side))
+			panic("illegal move valid: %s",
+			  move_as_long_string(state, &last->moves[i]));
+	}
+}
+
+static unsigned long long
+perft_r(struct board_state *state, int side, int depth,
+  struct last_moves *last)
+{
+	union move moves[MAX_MOVES];
+	struct undo_move_info undo_info;
+	struct perft_entry *e;
+	unsigned long long key, data, count;
+	int i, n;
+
+	if (depth == 0)
+		return 1;
+
+	n = get_legal_moves(moves, state, side);
+
+	if (perft.check_moves) {
+		check_moves(moves, n, state, side);
+		check_valid_moves(moves, n, &last[depth], state, side);
+
+		last[depth].n = n;
+		memcpy(last[depth].moves, moves, n*sizeof *moves);
+	}
+
+	if (depth == 1)
+		return n;
+
+	key = HASH_KEY(state, side);
+	e = NULL;
+
+	if (perft.table != NULL) {
+		e = &perft.table[key & perft.mask];
+		data = e->data;
+
+		if ((e->check ^ data) == key && (data & 0xff) == depth)
+			return data >> 8;
+	}
+
+	count = 0;
+
+	for (i = 0; i < n; i++) {
+		do_move(state, &moves[i], &undo_info);
+		count += perft_r(state, side^BLACK_FLAG, depth - 1, last);
+		undo_move(state, &undo_info);
+	}
+
+	if (e != NULL) {
+		data = count << 8 | depth;
+		e->check = key ^ data;
+		e->data = data;
+	}
+
+	return count;
+}
+
+static void *
+perft_thread(void *arg)
+{
+	struct board_state state;
+	struct undo_move_info undo_info;
+	struct last_moves *last;
+	int i;
+
+	state = perft.state;
+
+	if ((last = calloc(perft.depth, sizeof *last)) == NULL)
+		panic("out of memory");
+
+	for (;;) {
+		pthread_mutex_lock(&perft.lock);
+		i = perft.next_move++;
+		pthread_mutex_unlock(&perft.lock);
+
+		if (i >= perft.num_moves)
+			break;
+
+		do_move(&state, &perft.moves[i], &undo_info);
+		perft.counts[i] = perft_r(&state, perft.side^BLACK_FLAG,
+		  perft.depth - 1, last);
+		undo_move(&state, &undo_info);
+	}
+
+	free(last);
+
+	return NULL;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: perft [options] depth [move...]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Counts the positions depth plies after the initial "
+	  "one, or the one reached\nafter the given moves (written as in "
+	  "the move history).\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -t threads  number of threads [%d]\n",
+	  DEFAULT_NUM_THREADS);
+	fprintf(stderr, "  -H mbytes   size of the hash table [no table]\n");
+	fprintf(stderr, "  -c          check that no generated move leaves "
+	  "the king in check,\n              and that is_valid_move "
+	  "agrees with the generator\n");
+	fprintf(stderr, "  -h          this help\n");
+
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	pthread_t threads[MAX_THREADS];
+	struct undo_move_info undo_info;
+	union move move;
+	unsigned long long total;
+	unsigned long size;
+	long start_msecs, msecs;
+	int c, i, err, num_threads, hash_mbytes;
+	char *p;
+
+	num_threads = DEFAULT_NUM_THREADS;
+	hash_mbytes = 0;
+
+	while ((c = getopt(argc, argv, "t:H:ch")) != EOF) {
+		switch (c) {
+			case 't':
+				num_threads = strtol(optarg, &p, 10);
+				if (p == optarg || num_threads < 1 ||
+				  num_threads > MAX_THREADS)
+					usage();
+				break;
+
+			case 'H':
+				hash_mbytes = strtol(optarg, &p, 10);
+				if (p == optarg || hash_mbytes < 1)
+					usage();
+				break;
+
+			case 'c':
+				perft.check_moves = 1;
+				break;
+
+			case 'h':
+			default:
+				usage();
+		}
+	}
+
+	if (optind >= argc)
+		usage();
+
+	perft.depth = strtol(argv[optind], &p, 10);
+
+	if (p == argv[optind] || perft.depth < 1 || perft.depth > MAX_DEPTH)
+		usage();
+
+	init_hash_keys();
+	init_move_tables();
+
+	init_board_state(&perft.state);
+	perft.side = 0;
+
+	for (i = optind + 1; i < argc; i++) {
+		if (!parse_move(&move, &perft.state, perft.side, argv[i]))
+			panic("invalid or ambiguous move: %s", argv[i]);
+
+		do_move(&perft.state, &move, &undo_info);
+		perft.side ^= BLACK_FLAG;
+	}
+
+	if (hash_mbytes > 0) {
+		for (size = 1; 2*size*sizeof *perft.table <=
+		  hash_mbytes*(1UL << 20); size *= 2)
+			;
+
+		if ((perft.table = calloc(size, sizeof *perft.table)) == NULL)
+			panic("out of memory");
+
+		perft.mask = size - 1;
+	}
+
+	perft.num_moves = get_legal_moves(perft.moves, &perft.state,
+	  perft.side);
+	perft.next_move = 0;
+	pthread_mutex_init(&perft.lock, NULL);
+
+	start_msecs = get_msecs();
+
+	for (i = 0; i < num_threads; i++) {
+		err = pthread_create(&threads[i], NULL, perft_thread, NULL);
+
+		if (err != 0)
+			panic("couldn't start thread: %s", strerror(err));
+	}
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	msecs = get_msecs() - start_msecs;
+
+	total = 0;
+
+	for (i = 0; i < perft.num_moves; i++) {
+		printf("%s: %llu\n", move_as_string(&perft.state,
+		  &perft.moves[i]), perft.counts[i]);
+		total += perft.counts[i];
+	}
+
+	printf("\nmoves: %d\n", perft.num_moves);
+	printf("nodes: %llu\n", total);
+	printf("msecs: %ld\n", msecs);
+	printf("nodes per second: %llu\n",
+	  msecs > 0 ? total*1000/msecs : 0);
+
+	return 0;
+}
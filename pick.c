@@ -133,7 +133,8 @@ intersect_board_pieces(struct hit *hit, const struct ray *ray,
 		y = start_y;
 
 		for (j = 0; j < size; j++) {
-			p = *ps++;
+			p = *ps;
+			ps += BOARD_SQUARE_STRIDE;
 
 			if (p) {
 				struct matrix m, inv_m;
@@ -169,7 +170,7 @@ intersect_board_pieces(struct hit *hit, const struct ray *ray,
 			y += SQUARE_SIZE;
 		}
 
-		ps += BCOLS - size;
+		ps += (BCOLS - size)*BOARD_SQUARE_STRIDE;
 		x += SQUARE_SIZE;
 	}
 
@@ -234,7 +235,7 @@ pick_square(struct position *pos, const struct board_state *state,
 		get_main_board_xyz(&p, i);
 		get_main_board_position(&first_pos, i);
 
-		ps = &state->board[first_pos.level][first_pos.square];
+		ps = &BOARD_SQUARE(state, first_pos.level, first_pos.square);
 
 		if (intersect_board(&hit, &ray_obj, &p, ps, MAIN_BOARD_SIZE)) {
 			if (no_hits || hit.t < closer_t) {
@@ -255,8 +256,8 @@ pick_square(struct position *pos, const struct board_state *state,
 				get_attack_board_xyz(&p, i, j);
 				get_attack_board_position(&first_pos, i, j);
 
-				ps = &state->board
-				  [first_pos.level][first_pos.square];
+				ps = &BOARD_SQUARE(state, first_pos.level,
+				  first_pos.square);
 
 				if (intersect_board(&hit, &ray_obj, &p, ps,
 				  ATTACK_BOARD_SIZE)) {
@@ -326,7 +326,8 @@ render_board_pieces(const struct matrix *mv, const struct vector *board_pos,
 		p.y = start_y;
 
 		for (j = 0; j < size; j++) {
-			s = *ps++;
+			s = *ps;
+			ps += BOARD_SQUARE_STRIDE;
 
 			if (s != EMPTY)
 				render_piece_at(mv, &p, s, *pf, reflected);
@@ -336,7 +337,7 @@ render_board_pieces(const struct matrix *mv, const struct vector *board_pos,
 			++pf;
 		}
 
-		ps += BCOLS - size;
+		ps += (BCOLS - size)*BOARD_SQUARE_STRIDE;
 		pf += BCOLS - size;
 
 		p.x += SQUARE_SIZE;
@@ -585,7 +586,7 @@ render_boards(const struct board_state *state,
 		mat_transform_copy(&p->pos, mv, &p->orig_pos);
 
 		get_main_board_position(&pos, i);
-		p->state = &state->board[pos.level][pos.square];
+		p->state = &BOARD_SQUARE(state, pos.level, pos.square);
 		p->flags = &flags->selection[pos.level][pos.square];
 
 		++p;
@@ -602,7 +603,8 @@ render_boards(const struct board_state *state,
 				mat_transform_copy(&p->pos, mv, &p->orig_pos);
 
 				get_attack_board_position(&pos, i, j);
-				p->state = &state->board[pos.level][pos.square];
+				p->state = &BOARD_SQUARE(state, pos.level,
+				  pos.square);
 				p->flags = &flags->selection[pos.level]
 				  [pos.square];
 
@@ -0,0 +1,696 @@
+/* selfplay.c -- part of vulcan
+ *
+ * This program is copyright (C) 2006 Mauro Persano, and is free
+ * software which is freely distributable under the terms of the
+ * GNU public license, included as the file COPYING in this
+ * distribution.  It is NOT public domain software, and any
+ * redistribution not permitted by the GNU General Public License is
+ * expressly forbidden without prior written permission from
+ * the author.
+ *
+ */
+
+/*
+ * Plays matches between two engines, A and B, each a vulcan-engine
+ * process started with its own command line and searching with its own
+ * limits, several games at a time. Every opening is played twice, with A
+ * as white and then as black. Games nobody wins are drawn after a number
+ * of plies or on the third repetition of a position. The match can stop
+ * early by a sequential probability ratio test on A's Elo advantage.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "panic.h"
+#include "move.h"
+#include "game.h"
+
+enum {
+	DEFAULT_NUM_GAMES = 100,
+	DEFAULT_CONCURRENCY = 1,
+	DEFAULT_MAX_PLIES = 300,
+	MAX_CONCURRENCY = 64,
+	MAX_GAME_PLIES = 1000,
+	MAX_MOVE_STRING = 24,		/* longest move_as_long_string */
+	MAX_LINE = MAX_GAME_PLIES*MAX_MOVE_STRING + 256,
+	OPENING_SEED = 1,		/* order of the built-in openings */
+};
+
+#define DEFAULT_ENGINE "./vulcan-engine"
+#define DEFAULT_LIMITS "depth 4"
+#define SPRT_ALPHA .05
+#define SPRT_BETA .05
+
+/* a running engine, talked to through pipes */
+struct engine {
+	pid_t pid;
+	FILE *in;			/* its stdin */
+	FILE *out;			/* its stdout */
+};
+
+/* from A's point of view */
+enum game_result {
+	A_WINS,
+	DRAW,
+	A_LOSES,
+};
+
+static struct {
+	const char *commands[2];	/* engines A and B */
+	const char *limits[2];		/* arguments to their go commands */
+	char **openings;		/* lines of moves */
+	int num_openings;
+	int num_games;
+	int max_plies;
+	int sprt;
+	double elo0, elo1;
+	FILE *records;
+
+	/* protected by lock */
+	pthread_mutex_t lock;
+	int next_game;
+	int wins, draws, losses;	/* A's */
+	int stop;
+} match;
+
+static pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *
+xmalloc(size_t size)
+{
+	void *p;
+
+	if ((p = malloc(size)) == NULL)
+		panic("out of memory");
+
+	return p;
+}
+
+static char *
+xstrdup(const char *str)
+{
+	return strcpy(xmalloc(strlen(str) + 1), str);
+}
+
+/*
+ * start_engine --
+ *	Run command through the shell, with pipes to its stdin and stdout.
+ *	Engines started at the same time by other threads mustn't inherit
+ *	our ends of the pipes, or they'd never see end of file, so the pipes
+ *	are close-on-exec and made under spawn_lock.
+ */
+static void
+start_engine(struct engine *e, const char *command)
+{
+	int to[2], from[2], i, fd;
+
+	pthread_mutex_lock(&spawn_lock);
+
+	if (pipe(to) < 0 || pipe(from) < 0)
+		panic("pipe failed: %s", strerror(errno));
+
+	for (i = 0; i < 2; i++) {
+		fcntl(to[i], F_SETFD, FD_CLOEXEC);
+		fcntl(from[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	if ((e->pid = fork()) < 0)
+		panic("fork failed: %s", strerror(errno));
+
+	if (e->pid == 0) {
+		dup2(to[0], 0);
+		dup2(from[1], 1);
+
+		/* the search logs to stderr */
+		if ((fd = open("/dev/null", O_WRONLY)) >= 0)
+			dup2(fd, 2);
+
+		execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+		_exit(127);
+	}
+
+	close(to[0]);
+	close(from[1]);
+
+	if ((e->in = fdopen(to[1], "w")) == NULL ||
+	  (e->out = fdopen(from[0], "r")) == NULL)
+		panic("fdopen failed: %s", strerror(errno));
+
+	pthread_mutex_unlock(&spawn_lock);
+}
+
+static void
+stop_engine(struct engine *e)
+{
+	fprintf(e->in, "quit\n");
+	fclose(e->in);
+	fclose(e->out);
+	waitpid(e->pid, NULL, 0);
+}
+
+/*
+ * engine_move --
+ *	Have the engine search the position after moves (from the initial
+ *	one). The move it chose is returned in best_move. Returns 0 if the
+ *	engine died.
+ */
+static int
+engine_move(struct engine *e, const char *limits, const char *moves,
+  char *best_move)
+{
+	char line[MAX_LINE];
+	char *p;
+
+	fprintf(e->in, "position startpos moves%s\ngo %s\n", moves, limits);
+
+	if (fflush(e->in) == EOF)
+		return 0;
+
+	while (fgets(line, sizeof line, e->out) != NULL) {
+		if (strncmp(line, "bestmove ", 9))
+			continue;
+
+		p = line + 9;
+		p[strcspn(p, " \t\r\n")] = '\0';
+
+		snprintf(best_move, MAX_MOVE_STRING, "%.*s",
+		  MAX_MOVE_STRING - 1, p);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * play_game --
+ *	Play game number game between the engines, writing its moves and
+ *	how it ended in record.
+ */
+static enum game_result
+play_game(struct engine engines[2], int game, char *record)
+{
+	static const char *results[] = { "1-0", "1/2-1/2", "0-1" };
+	struct board_state state;
+	struct undo_move_info undo_info;
+	union move moves[MAX_MOVES], move;
+	unsigned long long keys[MAX_GAME_PLIES + 1];
+	char moves_str[MAX_LINE], best_move[MAX_MOVE_STRING];
+	char opening[MAX_LINE];
+	const char *reason;
+	char *str, *save;
+	int i, ply, side, a_side, e, winner, repeats;
+
+	init_board_state(&state);
+	side = 0;
+	a_side = game%2 ? BLACK_FLAG : 0;
+
+	moves_str[0] = '\0';
+	ply = 0;
+
+	/* the opening was checked when read, it's all legal */
+
+	strcpy(opening, match.openings[(game/2)%match.num_openings]);
+
+	for (str = strtok_r(opening, " \t", &save); str != NULL;
+	  str = strtok_r(NULL, " \t", &save)) {
+		parse_move(&move, &state, side, str);
+		keys[ply++] = HASH_KEY(&state, side);
+		sprintf(moves_str + strlen(moves_str), " %s",
+		  move_as_long_string(&state, &move));
+		do_move(&state, &move, &undo_info);
+		side ^= BLACK_FLAG;
+	}
+
+	winner = -1;			/* draw */
+
+	for (;;) {
+		if (get_legal_moves(moves, &state, side) == 0) {
+			winner = side^BLACK_FLAG;
+			reason = "mate";
+			break;
+		}
+
+		keys[ply] = HASH_KEY(&state, side);
+		repeats = 0;
+
+		for (i = ply - 2; i >= 0; i -= 2) {
+			if (keys[i] == keys[ply])
+				repeats++;
+		}
+
+		if (repeats >= 2) {
+			reason = "repetition";
+			break;
+		}
+
+		if (ply >= match.max_plies) {
+			reason = "move limit";
+			break;
+		}
+
+		e = side == a_side ? 0 : 1;
+
+		if (!engine_move(&engines[e], match.limits[e], moves_str,
+		  best_move)) {
+			winner = side^BLACK_FLAG;
+			reason = "engine died";
+
+			/* start it over for the next game */
+			stop_engine(&engines[e]);
+			start_engine(&engines[e], match.commands[e]);
+			break;
+		}
+
+		if (!parse_move(&move, &state, side, best_move)) {
+			winner = side^BLACK_FLAG;
+			reason = "illegal move";
+			break;
+		}
+
+		sprintf(moves_str + strlen(moves_str), " %s", best_move);
+		do_move(&state, &move, &undo_info);
+		side ^= BLACK_FLAG;
+		ply++;
+	}
+
+	i = winner < 0 ? 1 : winner == 0 ? 0 : 2;
+
+	sprintf(record, "game %d, opening %d, white %s, black %s: %s (%s):%s",
+	  game + 1, (game/2)%match.num_openings + 1, a_side ? "B" : "A",
+	  a_side ? "A" : "B", results[i], reason, moves_str);
+
+	if (winner < 0)
+		return DRAW;
+
+	return winner == a_side ? A_WINS : A_LOSES;
+}
+
+static double
+score_to_elo(double score)
+{
+	return -400*log10(1/score - 1);
+}
+
+static double
+elo_to_score(double elo)
+{
+	return 1/(1 + pow(10, -elo/400));
+}
+
+/*
+ * sprt_llr --
+ *	Log likelihood ratio of A being elo1 stronger than B rather than
+ *	elo0, with the normal approximation to the distribution of game
+ *	scores.
+ */
+static double
+sprt_llr(int wins, int draws, int losses, double elo0, double elo1)
+{
+	double n, score, var, s0, s1;
+
+	n = wins + draws + losses;
+
+	if (n == 0)
+		return 0;
+
+	score = (wins + draws/2.)/n;
+	var = (wins*(1 - score)*(1 - score) + draws*(.5 - score)*(.5 - score) +
+	  losses*score*score)/n;
+
+	if (var == 0)
+		return 0;
+
+	s0 = elo_to_score(elo0);
+	s1 = elo_to_score(elo1);
+
+	return n*(s1 - s0)*(2*score - s0 - s1)/(2*var);
+}
+
+/*
+ * add_result --
+ *	Count the result of a game, print the standings, and see if the
+ *	match is over. Called with match.lock held.
+ */
+static void
+add_result(enum game_result result, const char *record)
+{
+	double n, score, llr, lower, upper;
+
+	switch (result) {
+		case A_WINS:
+			match.wins++;
+			break;
+
+		case DRAW:
+			match.draws++;
+			break;
+
+		case A_LOSES:
+			match.losses++;
+			break;
+	}
+
+	if (match.records != NULL) {
+		fprintf(match.records, "%s\n", record);
+		fflush(match.records);
+	}
+
+	n = match.wins + match.draws + match.losses;
+	score = (match.wins + match.draws/2.)/n;
+
+	/* up to the moves */
+	printf("%.*s\n", (int)(strchr(record, ')') - record + 1), record);
+	printf("  A: +%d =%d -%d, score %.1f%%", match.wins, match.draws,
+	  match.losses, 100*score);
+
+	if (score > 0 && score < 1)
+		printf(", elo %+.0f", score_to_elo(score));
+
+	if (match.sprt) {
+		llr = sprt_llr(match.wins, match.draws, match.losses,
+		  match.elo0, match.elo1);
+		lower = log(SPRT_BETA/(1 - SPRT_ALPHA));
+		upper = log((1 - SPRT_BETA)/SPRT_ALPHA);
+
+		printf(", llr %.2f (%.2f, %.2f)", llr, lower, upper);
+
+		if (llr <= lower) {
+			printf("\nH0 accepted: A is not %g elo stronger",
+			  match.elo1);
+			match.stop = 1;
+		} else if (llr >= upper) {
+			printf("\nH1 accepted: A is %g elo stronger",
+			  match.elo1);
+			match.stop = 1;
+		}
+	}
+
+	printf("\n");
+	fflush(stdout);
+}
+
+static void *
+match_thread(void *arg)
+{
+	struct engine engines[2];
+	enum game_result result;
+	char *record;
+	int game;
+
+	record = xmalloc(MAX_LINE + 256);
+
+	start_engine(&engines[0], match.commands[0]);
+	start_engine(&engines[1], match.commands[1]);
+
+	for (;;) {
+		pthread_mutex_lock(&match.lock);
+		game = match.next_game++;
+		pthread_mutex_unlock(&match.lock);
+
+		if (game >= match.num_games || match.stop)
+			break;
+
+		result = play_game(engines, game, record);
+
+		pthread_mutex_lock(&match.lock);
+		if (!match.stop)
+			add_result(result, record);
+		pthread_mutex_unlock(&match.lock);
+	}
+
+	stop_engine(&engines[0]);
+	stop_engine(&engines[1]);
+
+	free(record);
+
+	return NULL;
+}
+
+static void
+add_opening(const char *line)
+{
+	static int max_openings;
+
+	if (match.num_openings == max_openings) {
+		max_openings = max_openings ? 2*max_openings : 256;
+
+		if ((match.openings = realloc(match.openings,
+		  max_openings*sizeof *match.openings)) == NULL)
+			panic("out of memory");
+	}
+
+	match.openings[match.num_openings++] = xstrdup(line);
+}
+
+/*
+ * read_openings --
+ *	One opening per line, as moves from the initial position, written
+ *	as in the move history or the long way. Blank lines and lines
+ *	starting with # are skipped.
+ */
+static void
+read_openings(const char *path)
+{
+	struct board_state state;
+	struct undo_move_info undo_info;
+	union move move;
+	char line[MAX_LINE], moves_str[MAX_LINE];
+	char *str;
+	FILE *in;
+	int side, line_number, ply;
+
+	if ((in = fopen(path, "r")) == NULL)
+		panic("couldn't open %s: %s", path, strerror(errno));
+
+	for (line_number = 1; fgets(line, sizeof line, in) != NULL;
+	  line_number++) {
+		line[strcspn(line, "#\r\n")] = '\0';
+
+		init_board_state(&state);
+		side = 0;
+		moves_str[0] = '\0';
+		ply = 0;
+
+		for (str = strtok(line, " \t"); str != NULL;
+		  str = strtok(NULL, " \t")) {
+			if (!parse_move(&move, &state, side, str))
+				panic("%s:%d: invalid or ambiguous move: %s",
+				  path, line_number, str);
+
+			if (++ply > match.max_plies)
+				panic("%s:%d: opening longer than the move "
+				  "limit", path, line_number);
+
+			sprintf(moves_str + strlen(moves_str), " %s",
+			  move_as_long_string(&state, &move));
+			do_move(&state, &move, &undo_info);
+			side ^= BLACK_FLAG;
+		}
+
+		if (ply > 0)
+			add_opening(moves_str);
+	}
+
+	fclose(in);
+
+	if (match.num_openings == 0)
+		panic("no openings in %s", path);
+}
+
+/*
+ * make_openings --
+ *	Without an openings file, play every pair of first moves, in an
+ *	order that's shuffled but the same every time.
+ */
+static void
+make_openings(void)
+{
+	struct board_state state;
+	struct undo_move_info undo_info;
+	union move white_moves[MAX_MOVES], black_moves[MAX_MOVES];
+	char line[2*MAX_MOVE_STRING + 2];
+	char *tmp;
+	int i, j, nw, nb;
+
+	init_board_state(&state);
+	nw = get_legal_moves(white_moves, &state, 0);
+
+	for (i = 0; i < nw; i++) {
+		strcpy(line, move_as_long_string(&state, &white_moves[i]));
+		do_move(&state, &white_moves[i], &undo_info);
+
+		nb = get_legal_moves(black_moves, &state, BLACK_FLAG);
+
+		for (j = 0; j < nb; j++) {
+			sprintf(line + strlen(line), " %s",
+			  move_as_long_string(&state, &black_moves[j]));
+			add_opening(line);
+			line[strcspn(line, " ")] = '\0';
+		}
+
+		undo_move(&state, &undo_info);
+	}
+
+	srand(OPENING_SEED);
+
+	for (i = match.num_openings - 1; i > 0; i--) {
+		j = rand()%(i + 1);
+		tmp = match.openings[i];
+		match.openings[i] = match.openings[j];
+		match.openings[j] = tmp;
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: selfplay [options]\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Plays engine A against engine B and reports A's "
+	  "results.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -a command    engine A [%s]\n", DEFAULT_ENGINE);
+	fprintf(stderr, "  -b command    engine B [%s]\n", DEFAULT_ENGINE);
+	fprintf(stderr, "  -A limits     go limits for A, e.g. \"movetime "
+	  "200\" [%s]\n", DEFAULT_LIMITS);
+	fprintf(stderr, "  -B limits     go limits for B [%s]\n",
+	  DEFAULT_LIMITS);
+	fprintf(stderr, "  -j games      games played at the same time "
+	  "[%d]\n", DEFAULT_CONCURRENCY);
+	fprintf(stderr, "  -g games      number of games [%d]\n",
+	  DEFAULT_NUM_GAMES);
+	fprintf(stderr, "  -m plies      plies before a game is drawn "
+	  "[%d]\n", DEFAULT_MAX_PLIES);
+	fprintf(stderr, "  -o file       openings, one line of moves each "
+	  "[all first move pairs]\n");
+	fprintf(stderr, "  -r file       write the games to file\n");
+	fprintf(stderr, "  -s elo0,elo1  stop when a sequential probability "
+	  "ratio test decides\n                whether A is elo0 or elo1 "
+	  "stronger than B\n");
+	fprintf(stderr, "  -h            this help\n");
+
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	pthread_t threads[MAX_CONCURRENCY];
+	const char *openings_path, *records_path;
+	int c, i, err, concurrency;
+	char *p;
+
+	match.commands[0] = match.commands[1] = DEFAULT_ENGINE;
+	match.limits[0] = match.limits[1] = DEFAULT_LIMITS;
+	match.num_games = DEFAULT_NUM_GAMES;
+	match.max_plies = DEFAULT_MAX_PLIES;
+	concurrency = DEFAULT_CONCURRENCY;
+	openings_path = records_path = NULL;
+
+	while ((c = getopt(argc, argv, "a:b:A:B:j:g:m:o:r:s:h")) != EOF) {
+		switch (c) {
+			case 'a':
+				match.commands[0] = optarg;
+				break;
+
+			case 'b':
+				match.commands[1] = optarg;
+				break;
+
+			case 'A':
+				match.limits[0] = optarg;
+				break;
+
+			case 'B':
+				match.limits[1] = optarg;
+				break;
+
+			case 'j':
+				concurrency = strtol(optarg, &p, 10);
+				if (p == optarg || concurrency < 1 ||
+				  concurrency > MAX_CONCURRENCY)
+					usage();
+				break;
+
+			case 'g':
+				match.num_games = strtol(optarg, &p, 10);
+				if (p == optarg || match.num_games < 1)
+					usage();
+				break;
+
+			case 'm':
+				match.max_plies = strtol(optarg, &p, 10);
+				if (p == optarg || match.max_plies < 1 ||
+				  match.max_plies > MAX_GAME_PLIES)
+					usage();
+				break;
+
+			case 'o':
+				openings_path = optarg;
+				break;
+
+			case 'r':
+				records_path = optarg;
+				break;
+
+			case 's':
+				if (sscanf(optarg, "%lf,%lf", &match.elo0,
+				  &match.elo1) != 2 ||
+				  match.elo0 >= match.elo1)
+					usage();
+				match.sprt = 1;
+				break;
+
+			case 'h':
+			default:
+				usage();
+		}
+	}
+
+	if (optind != argc)
+		usage();
+
+	/* an engine dying shows up as end of file, not a signal */
+	signal(SIGPIPE, SIG_IGN);
+
+	init_hash_keys();
+	init_move_tables();
+
+	if (openings_path != NULL)
+		read_openings(openings_path);
+	else
+		make_openings();
+
+	if (records_path != NULL && (match.records = fopen(records_path,
+	  "w")) == NULL)
+		panic("couldn't open %s: %s", records_path, strerror(errno));
+
+	pthread_mutex_init(&match.lock, NULL);
+
+	for (i = 0; i < concurrency; i++) {
+		err = pthread_create(&threads[i], NULL, match_thread, NULL);
+
+		if (err != 0)
+			panic("couldn't start thread: %s", strerror(err));
+	}
+
+	for (i = 0; i < concurrency; i++)
+		pthread_join(threads[i], NULL);
+
+	if (match.records != NULL)
+		fclose(match.records);
+
+	return 0;
+}
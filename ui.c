@@ -38,6 +38,7 @@
 #include "move.h"
 #include "game.h"
 #include "engine.h"
+#include "book.h"
 #include "font.h"
 #include "font_render.h"
 #include "menu.h"
@@ -62,6 +63,9 @@ static struct {
 };
 
 extern long msecs(void);
+extern void worker_move_now(void);
+extern void cancel_worker_request(void);
+extern void stop_pondering(void);
 
 struct ui ui;
 
@@ -191,8 +195,15 @@ ui_reset_game(void)
 	memset(&ui.selected_squares, UNSELECTED_SQUARE,
 	  sizeof ui.selected_squares);
 
+	/* don't let the searches for the old game go on in the new one */
+	if (ui.computer_player_state == THINKING)
+		cancel_worker_request();
+	else if (ui.ponder)
+		stop_pondering();
+
 	ui.computer_player_state = IDLE;
 	ui.cur_side = 0;
+	ui_update_legal_moves();
 	ui.start_position_selected = 0;
 	ui.pos_highlighted = 0;
 
@@ -201,6 +212,8 @@ ui_reset_game(void)
 
 	ui.move_history = list_make();
 
+	memset(&ui.search_stats, 0, sizeof ui.search_stats);
+
 	ui.ply_prev_msecs = 0;
 	ui.white_player_msecs = 0;
 	ui.black_player_msecs = 0;
@@ -216,14 +229,18 @@ ui_reset_game(void)
 
 void
 ui_initialize(enum player_type white_player, enum player_type black_player,
-  int max_depth, int width, int height)
+  int max_depth, long max_msecs, int num_threads, int parallel_search,
+  int width, int height)
 {
+	init_hash_keys();
 	init_move_tables();
-	init_engine();
+	init_engine(num_threads, parallel_search);
+	book_open(BOOK_PATH);
 
 	ui.players[0] = white_player;
 	ui.players[1] = black_player;
 	ui.max_depth = max_depth;
+	ui.max_msecs = max_msecs;
 
 	ui.cur_width = width;
 	ui.cur_height = height;
@@ -239,10 +256,40 @@ ui_initialize(enum player_type white_player, enum player_type black_player,
 	ui.do_reflections = 0;
 	ui.do_textures = 0;
 	ui.do_move_history = 1;
+	ui.do_search_stats = 0;
 
 	ui_reset_game();
 }
 
+/*
+ * ui_get_think_msecs --
+ *	Time budget for the computer's next move, from the side's clock:
+ *	each side gets the per-move time for every move it has made, so
+ *	time left over from earlier moves (book moves, searches that
+ *	stopped early) goes to this one, and time overspent is taken
+ *	from it. Between a quarter and twice the per-move time.
+ */
+long
+ui_get_think_msecs(void)
+{
+	long used, budget;
+
+	if (ui.cur_side == BLACK_FLAG)
+		used = ui.black_player_msecs;
+	else
+		used = ui.white_player_msecs;
+
+	/* moves made by the side to move, plus this one */
+	budget = (ui.board_state.cur_ply/2 + 1)*ui.max_msecs - used;
+
+	if (budget < ui.max_msecs/4)
+		budget = ui.max_msecs/4;
+	else if (budget > 2*ui.max_msecs)
+		budget = 2*ui.max_msecs;
+
+	return budget;
+}
+
 void
 ui_on_worker_reply(union move *next_move)
 {
@@ -327,3 +374,14 @@ ui_on_escape_release(void)
 {
 	ui.cur_state->common.on_escape_release(ui.cur_state);
 }
+
+/*
+ * ui_on_move_now --
+ *	Make the computer play the best move it has found so far.
+ */
+void
+ui_on_move_now(void)
+{
+	if (ui.computer_player_state == THINKING)
+		worker_move_now();
+}
@@ -14,6 +14,8 @@
 #define UI_H_
 
 #include "game.h"
+#include "move.h"
+#include "engine.h"
 #include "vector.h"
 #include "matrix.h"
 #include "ui_state.h"
@@ -32,12 +34,41 @@ enum computer_player_state {
 
 struct list;
 
+struct move_range {
+	unsigned char first;			/* index in legal_moves.moves */
+	unsigned char count;
+};
+
+/*
+ * Legal moves of the side to move, generated once a ply, grouped by where
+ * the player clicks to make them.
+ */
+struct legal_moves {
+	union move moves[MAX_MOVES];
+	int num_moves;
+
+	/*
+	 * moves of the piece on a square (castling is the king's), or
+	 * of the attack board under an empty square
+	 */
+	struct move_range from_square[BLEVELS][BAREA];
+
+	struct move_range from_attack_board[NUM_MAIN_BOARDS][8];
+};
+
 struct ui {
 	struct board_state board_state;
+	struct legal_moves legal_moves;
 	struct selected_squares selected_squares;
 
 	int cur_side;
-	int max_depth;				/* max AI search depth */
+	int max_depth;				/* max AI search depth, if
+						 * not MAX_SEARCH_DEPTH */
+	long max_msecs;				/* average AI time per move */
+	int ponder;				/* AI thinks on opponent's
+						 * time */
+	int mate_moves;				/* AI looks for mates in up
+						 * to this many moves first */
 	enum computer_player_state computer_player_state;
 	enum player_type players[2];
 
@@ -53,6 +84,7 @@ struct ui {
 	int do_reflections;
 	int do_textures;
 	int do_move_history;
+	int do_search_stats;
 
 	struct position last_selected_pos;	/* last square selected by
 						 * user  */
@@ -83,6 +115,9 @@ struct ui {
 
 	int to_quit;
 
+	struct search_stats search_stats;	/* of the computer's last
+						 * move */
+
 	long ply_prev_msecs;
 	long white_player_msecs;
 	long black_player_msecs;
@@ -118,7 +153,11 @@ ui_reset_game(void);
 
 void
 ui_initialize(enum player_type white_player,
-  enum player_type black_player, int max_depth, int width, int height);
+  enum player_type black_player, int max_depth, long max_msecs,
+  int num_threads, int parallel_search, int width, int height);
+
+long
+ui_get_think_msecs(void);
 
 void
 gl_initialize(void);
@@ -132,6 +171,9 @@ ui_on_escape_press(void);
 void
 ui_on_escape_release(void);
 
+void
+ui_on_move_now(void);
+
 enum ui_state_type;
 
 void
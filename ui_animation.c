@@ -132,16 +132,16 @@ on_state_switch(union ui_state *state)
 
 	animation->duration = dist/animation_speed;
 	animation->start_t = msecs();
-	animation->piece = ui.board_state.board[move->piece_move.to.level]
-	  [move->piece_move.to.square];
+	animation->piece = BOARD_SQUARE(&ui.board_state,
+	  move->piece_move.to.level, move->piece_move.to.square);
 
 	animation->prev_board_state = ui.board_state;
 
 	undo_move(&animation->prev_board_state, &ui.last_undo_info);
 
-	animation->prev_board_state.board
-	  [ui.animation_move.piece_move.from.level]
-	  [ui.animation_move.piece_move.from.square] = EMPTY;
+	BOARD_SQUARE(&animation->prev_board_state,
+	  ui.animation_move.piece_move.from.level,
+	  ui.animation_move.piece_move.from.square) = EMPTY;
 }
 
 struct state_animation state_animation = {
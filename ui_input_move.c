@@ -78,6 +78,8 @@ game_do_move(union move *move)
 			strcat(last_move_buf, "+");
 	}
 
+	ui_update_legal_moves();
+
 	list_append(ui.move_history, strdup(last_move_buf));
 
 	if (move->type == PIECE_MOVE) {
@@ -144,9 +146,9 @@ mark_selected_attack_board(struct selected_squares *selected,
 static void
 mark_selected_squares(struct selected_squares *selected,
   const struct board_state *state, 
-  int side, union move *moves, int num_moves)
+  int side, const union move *moves, int num_moves)
 {
-	union move *move, *end;
+	const union move *move, *end;
 	const struct position *pos;
 	unsigned char s;
 	enum selection_type t;
@@ -162,7 +164,8 @@ mark_selected_squares(struct selected_squares *selected,
 
 				pos = &move->piece_move.to;
 
-				s = state->board[pos->level][pos->square];
+				s = BOARD_SQUARE(state, pos->level,
+				  pos->square);
 
 				if (s == EMPTY || (s & BLACK_FLAG) == side)
 					t = SELECTED_SQUARE;
@@ -230,13 +233,14 @@ reset_selected_squares(void)
 static void
 on_start_position_selected(struct position *pos)
 {
-	union move moves[MAX_MOVES];
+	const union move *moves;
 	int n;
 
 	reset_selected_squares();
 
-	if ((n = get_legal_moves_for_position(moves, pos, &ui.board_state,
-	  ui.cur_side)) == 0) {
+	moves = ui_get_legal_moves_for_position(&n, pos);
+
+	if (n == 0) {
 		ui.start_position_selected = 0;
 	} else {
 		mark_selected_squares(&ui.selected_squares,
@@ -254,15 +258,16 @@ on_start_position_selected(struct position *pos)
 static void
 on_end_position_selected(struct position *pos)
 {
-	union move moves[MAX_MOVES];
-	union move *selected_move;
+	const union move *moves, *selected_move;
+	union move move;
 	struct position closest, *start;
 	int i, n;
 
 	start = &ui.last_selected_pos;
 
-	assert((n = get_legal_moves_for_position(moves,
-	  start, &ui.board_state, ui.cur_side)) > 0);
+	moves = ui_get_legal_moves_for_position(&n, start);
+
+	assert(n > 0);
 
 	selected_move = NULL;
 
@@ -330,7 +335,9 @@ on_end_position_selected(struct position *pos)
 	if (selected_move != NULL) {
 		reset_selected_squares();
 
-		game_do_move(selected_move);
+		/* the move list is regenerated for the next ply */
+		move = *selected_move;
+		game_do_move(&move);
 
 		ui.start_position_selected = 0;
 	}
@@ -345,7 +352,7 @@ is_same_position(struct position *a, struct position *b)
 static void
 on_position_selected(struct position *pos)
 {
-	union move moves[MAX_MOVES];
+	int n;
 
 	if (ui.start_position_selected &&
 	  !is_same_position(&ui.last_selected_pos, pos) &&
@@ -354,8 +361,9 @@ on_position_selected(struct position *pos)
 		on_end_position_selected(pos);
 	}
 
-	if (get_legal_moves_for_position(moves, pos, &ui.board_state,
-	  ui.cur_side) > 0) {
+	ui_get_legal_moves_for_position(&n, pos);
+
+	if (n > 0) {
 		on_start_position_selected(pos);
 	}
 }
@@ -434,8 +442,8 @@ highlight_piece_at(int x, int y)
 	ui_set_modelview_matrix(&mv);
 
 	if (pick_square(&pos, &ui.board_state, &mv, x, y)) {
-		const int s = ui.board_state.board[pos.level]
-		  [pos.square];
+		const int s = BOARD_SQUARE(&ui.board_state, pos.level,
+		  pos.square);
 
 		if (s != EMPTY && (s & BLACK_FLAG) == ui.cur_side) {
 			if (!(ui.start_position_selected &&
@@ -113,10 +113,45 @@ menu_toggle_black_player_type(void *extra)
 	  ui.players[1] == HUMAN_PLAYER ? COMPUTER_PLAYER : HUMAN_PLAYER;
 }
 
+/* MAX_SEARCH_DEPTH: the time per move is the only limit */
+static const int search_depth_choices[] = { MAX_SEARCH_DEPTH, 4, 6, 8 };
+
+enum {
+	NUM_SEARCH_DEPTH_CHOICES =
+	  sizeof search_depth_choices/sizeof *search_depth_choices
+};
+
 static void
 menu_toggle_max_search_depth(void *extra)
 {
-	ui.max_depth = 3 + (ui.max_depth - 3 + 1)%3;
+	int i;
+
+	for (i = 0; i < NUM_SEARCH_DEPTH_CHOICES; i++) {
+		if (search_depth_choices[i] == ui.max_depth)
+			break;
+	}
+
+	ui.max_depth = search_depth_choices[(i + 1)%NUM_SEARCH_DEPTH_CHOICES];
+}
+
+static const long think_secs_choices[] = { 5, 10, 30, 60 };
+
+enum {
+	NUM_THINK_SECS_CHOICES =
+	  sizeof think_secs_choices/sizeof *think_secs_choices
+};
+
+static void
+menu_toggle_max_think_time(void *extra)
+{
+	int i;
+
+	for (i = 0; i < NUM_THINK_SECS_CHOICES; i++) {
+		if (think_secs_choices[i]*1000 > ui.max_msecs)
+			break;
+	}
+
+	ui.max_msecs = think_secs_choices[i%NUM_THINK_SECS_CHOICES]*1000;
 }
 
 static const char *
@@ -136,11 +171,24 @@ menu_get_max_search_depth(void *extra)
 {
 	static char depth_str[20];
 
+	if (ui.max_depth == MAX_SEARCH_DEPTH)
+		return "Any";
+
 	sprintf(depth_str, "%d", ui.max_depth);
 
 	return depth_str;
 }
 
+static const char *
+menu_get_max_think_time(void *extra)
+{
+	static char time_str[20];
+
+	sprintf(time_str, "%lds", ui.max_msecs/1000);
+
+	return time_str;
+}
+
 #if 0
 static void
 menu_about(void *extra)
@@ -190,6 +238,10 @@ initialize(union ui_state *state)
 	  menu_toggle_max_search_depth, NULL,
 	  menu_get_max_search_depth, NULL);
 
+	menu_add_toggle_item(main_menu, "Time per move:",
+	  menu_toggle_max_think_time, NULL,
+	  menu_get_max_think_time, NULL);
+
 	add_options_menu(main_menu);
 
 	menu_add_action_item(main_menu, "Quit", menu_quit, NULL);
@@ -42,6 +42,18 @@ menu_get_move_history_flag(void *extra)
 	return FLAG_AS_STR(ui.do_move_history);
 }
 
+static void
+menu_toggle_search_stats_flag(void *extra)
+{
+	ui.do_search_stats ^= 1;
+}
+
+static const char *
+menu_get_search_stats_flag(void *extra)
+{
+	return FLAG_AS_STR(ui.do_search_stats);
+}
+
 void
 add_options_menu(struct menu *menu)
 {
@@ -60,4 +72,8 @@ add_options_menu(struct menu *menu)
 	menu_add_toggle_item(options_menu, "Move History:",
 	  menu_toggle_move_history_flag, NULL,
 	  menu_get_move_history_flag, NULL);
+
+	menu_add_toggle_item(options_menu, "Search Stats:",
+	  menu_toggle_search_stats_flag, NULL,
+	  menu_get_search_stats_flag, NULL);
 }
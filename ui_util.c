@@ -11,9 +11,12 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include "render.h"
+#include "game.h"
+#include "move.h"
 #include "ui_util.h"
 #include "font_render.h"
 #include "list.h"
@@ -57,6 +60,130 @@ ui_render_board_state(void)
 	  &mv);
 }
 
+static struct move_range *
+get_move_range(struct legal_moves *lm, const union move *move)
+{
+	const struct piece_move *pm;
+	const struct attack_board *ab;
+
+	switch (move->type) {
+		case PIECE_MOVE:
+			pm = &move->piece_move;
+			return &lm->from_square[pm->from.level]
+			  [pm->from.square];
+
+		case ATTACK_BOARD_MOVE:
+			ab = &move->attack_board_move.from;
+			return &lm->from_attack_board[ab->main_board]
+			  [ab->position];
+
+		case WHITE_KINGSIDE_CASTLING:
+		case WHITE_QUEENSIDE_CASTLING:
+			return &lm->from_square[4][11*BCOLS + 5];
+
+		default:
+			return &lm->from_square[0][2*BCOLS + 5];
+	}
+}
+
+/*
+ * ui_update_legal_moves --
+ *	Generate the legal moves of the side to move, for the input
+ *	handlers to look up as the player clicks. Called whenever the
+ *	position changes.
+ */
+void
+ui_update_legal_moves(void)
+{
+	union move moves[MAX_MOVES];
+	struct move_range *ranges[MAX_MOVES], *r, *end;
+	struct legal_moves *lm;
+	struct position first;
+	int i, j, k, n, row, col, square;
+
+	lm = &ui.legal_moves;
+
+	memset(lm->from_square, 0, sizeof lm->from_square);
+	memset(lm->from_attack_board, 0, sizeof lm->from_attack_board);
+
+	n = get_legal_moves(moves, &ui.board_state, ui.cur_side);
+
+	/* count the moves from each origin, then group them */
+
+	for (i = 0; i < n; i++) {
+		ranges[i] = get_move_range(lm, &moves[i]);
+		ranges[i]->count++;
+	}
+
+	k = 0;
+
+	r = &lm->from_square[0][0];
+	end = r + sizeof lm->from_square/sizeof *r;
+
+	for (; r != end; r++) {
+		r->first = k;
+		k += r->count;
+		r->count = 0;
+	}
+
+	r = &lm->from_attack_board[0][0];
+	end = r + sizeof lm->from_attack_board/sizeof *r;
+
+	for (; r != end; r++) {
+		r->first = k;
+		k += r->count;
+		r->count = 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		r = ranges[i];
+		lm->moves[r->first + r->count++] = moves[i];
+	}
+
+	lm->num_moves = n;
+
+	/* an attack board is moved by clicking on an empty square of it */
+
+	for (i = 0; i < NUM_MAIN_BOARDS; i++) {
+		for (j = 0; j < 8; j++) {
+			if (lm->from_attack_board[i][j].count == 0)
+				continue;
+
+			get_attack_board_position(&first, i, j);
+
+			for (row = 0; row < ATTACK_BOARD_SIZE; row++) {
+				for (col = 0; col < ATTACK_BOARD_SIZE; col++) {
+					square = first.square + row*BCOLS +
+					  col;
+
+					if (BOARD_SQUARE(&ui.board_state,
+					  first.level, square) == EMPTY)
+						lm->from_square[first.level]
+						  [square] =
+						    lm->from_attack_board[i][j];
+				}
+			}
+		}
+	}
+}
+
+/*
+ * ui_get_legal_moves_for_position --
+ *	Like get_legal_moves_for_position, from the moves generated by
+ *	ui_update_legal_moves.
+ */
+const union move *
+ui_get_legal_moves_for_position(int *num_moves, const struct position *pos)
+{
+	const struct move_range *r;
+
+	r = &ui.legal_moves.from_square[pos->level][pos->square];
+
+	*num_moves = r->count;
+
+	return &ui.legal_moves.moves[r->first];
+}
+
 enum {
 	MOVE_TABLE_ROWS = 6,
 	MOVE_HISTORY_BORDER = 4
@@ -182,6 +309,56 @@ ui_render_move_history(void)
 	}
 }
 
+/*
+ * ui_render_search_stats --
+ *	Statistics of the computer's last search, under white's clock.
+ */
+void
+ui_render_search_stats(void)
+{
+	const struct font_render_info *const font = ui.font_small;
+	const struct search_stats *const stats = &ui.search_stats;
+	char str[120];
+	int i, y;
+
+	/* book or mate finder move */
+	if (stats->nodes == 0)
+		return;
+
+	glColor4f(1.f, 1.f, 1.f, 1.f);
+
+	y = 90;
+
+	sprintf(str, "Depth %d, score %d", stats->depth, stats->score);
+	render_string(font, str, 2, y);
+	y += font->char_height + 2;
+
+	sprintf(str, "%lu nodes, %lu%% quiescence, %lu knps", stats->nodes,
+	  stats->qnodes*100/stats->nodes, stats->nps/1000);
+	render_string(font, str, 2, y);
+	y += font->char_height + 2;
+
+	sprintf(str, "Cutoffs on first move %lu%%, hash hits %lu%%",
+	  stats->cutoffs ?
+	    stats->first_move_cutoffs*100/stats->cutoffs : 0,
+	  stats->tt_probes ? stats->tt_hits*100/stats->tt_probes : 0);
+	render_string(font, str, 2, y);
+	y += font->char_height + 2;
+
+	sprintf(str, "Branching factor %.2f", stats->branching_factor);
+	render_string(font, str, 2, y);
+	y += font->char_height + 2;
+
+	/* time to finish each iteration, the last few */
+	strcpy(str, "Iterations (msecs)");
+
+	for (i = stats->num_iterations > 6 ? stats->num_iterations - 6 : 0;
+	  i < stats->num_iterations; i++)
+		sprintf(str + strlen(str), " %ld", stats->iteration_msecs[i]);
+
+	render_string(font, str, 2, y);
+}
+
 void
 ui_render_text(void)
 {
@@ -189,4 +366,7 @@ ui_render_text(void)
 
 	if (ui.do_move_history)
 		ui_render_move_history();
+
+	if (ui.do_search_stats)
+		ui_render_search_stats();
 }
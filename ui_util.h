@@ -21,6 +21,12 @@ ui_set_modelview_matrix(struct matrix *mv);
 void
 ui_render_board_state(void);
 
+void
+ui_update_legal_moves(void);
+
+const union move *
+ui_get_legal_moves_for_position(int *num_moves, const struct position *pos);
+
 void
 ui_render_text(void);
 
@@ -30,6 +36,9 @@ ui_render_move_history(void);
 void
 ui_render_clock(void);
 
+void
+ui_render_search_stats(void);
+
 void
 ui_render_text(void);
 